@@ -26,6 +26,11 @@
 #include "exception.h"
 #include "command.h"
 #include "gdb_packet.h"
+#include "gdb_main.h"
+#include "gdb_hostio.h"
+#if defined(LIBFTDI)
+#	include "hostio_fs.h"
+#endif
 #include "target.h"
 #include "morse.h"
 #include "version.h"
@@ -53,6 +58,11 @@ static bool cmd_morse(void);
 static bool cmd_halt_timeout(target *t, int argc, const char **argv);
 static bool cmd_connect_srst(target *t, int argc, const char **argv);
 static bool cmd_hard_srst(void);
+static bool cmd_halt_poll(target *t, int argc, const char **argv);
+static bool cmd_semihosting_console(target *t, int argc, const char **argv);
+#if defined(LIBFTDI)
+static bool cmd_semihosting_dir(target *t, int argc, const char **argv);
+#endif
 #ifdef PLATFORM_HAS_POWER_SWITCH
 static bool cmd_target_power(target *t, int argc, const char **argv);
 #endif
@@ -62,6 +72,10 @@ static bool cmd_traceswo(target *t, int argc, const char **argv);
 #ifdef PLATFORM_HAS_DEBUG
 static bool cmd_debug_bmp(target *t, int argc, const char **argv);
 #endif
+#ifdef PLATFORM_HAS_FREQUENCY
+static bool cmd_frequency(target *t, int argc, const char **argv);
+static bool cmd_swdp_calibrate(target *t, int argc, const char **argv);
+#endif
 
 const struct command_s cmd_list[] = {
 	{"version", (cmd_handler)cmd_version, "Display firmware version info"},
@@ -73,6 +87,13 @@ const struct command_s cmd_list[] = {
 	{"halt_timeout", (cmd_handler)cmd_halt_timeout, "Timeout (ms) to wait until Cortex-M is halted: (Default 2000)" },
 	{"connect_srst", (cmd_handler)cmd_connect_srst, "Configure connect under SRST: (enable|disable)" },
 	{"hard_srst", (cmd_handler)cmd_hard_srst, "Force a pulse on the hard SRST line - disconnects target" },
+	{"halt_poll", (cmd_handler)cmd_halt_poll, "Halt poll interval (ms) while running, backs off from min to max: [(min) (max)]" },
+#if defined(LIBFTDI)
+	{"semihosting_console", (cmd_handler)cmd_semihosting_console, "Semihosting console output through: (gdb|probe|stdout)" },
+	{"semihosting_dir", (cmd_handler)cmd_semihosting_dir, "Serve semihosting files from a host directory, 'gdb' to use GDB: [(dir)|gdb]" },
+#else
+	{"semihosting_console", (cmd_handler)cmd_semihosting_console, "Semihosting console output through: (gdb|probe)" },
+#endif
 #ifdef PLATFORM_HAS_POWER_SWITCH
 	{"tpwr", (cmd_handler)cmd_target_power, "Supplies power to the target: (enable|disable)"},
 #endif
@@ -81,6 +102,10 @@ const struct command_s cmd_list[] = {
 #endif
 #ifdef PLATFORM_HAS_DEBUG
 	{"debug_bmp", (cmd_handler)cmd_debug_bmp, "Output BMP \"debug\" strings to the second vcom: (enable|disable)"},
+#endif
+#ifdef PLATFORM_HAS_FREQUENCY
+	{"frequency", (cmd_handler)cmd_frequency, "Set JTAG/SWD clock frequency in Hz, 0 for default: [(frequency)]" },
+	{"swdp_calibrate", (cmd_handler)cmd_swdp_calibrate, "Calibrate SWD clock on attach, overwrites RAM temporarily: (enable|disable)" },
 #endif
 	{NULL, NULL, NULL}
 };
@@ -89,7 +114,12 @@ static bool connect_assert_srst;
 #ifdef PLATFORM_HAS_DEBUG
 bool debug_bmp;
 #endif
+#ifdef PLATFORM_HAS_FREQUENCY
+bool swdp_calibrate;
+#endif
 long cortexm_wait_timeout = 2000; /* Timeout to wait for Cortex to react on halt command. */
+uint32_t halt_poll_min = 0; /* First re-poll is immediate, catches short runs */
+uint32_t halt_poll_max = 32; /* Keeps the stop latency GDB sees low */
 
 int command_process(target *t, char *cmd)
 {
@@ -236,6 +266,11 @@ bool cmd_targets(void)
 		gdb_out("No usable targets found.\n");
 		return false;
 	}
+#ifdef PLATFORM_HAS_FREQUENCY
+	if (swdp_calibrated_frequency)
+		gdb_outf("SWD clock: %" PRIu32 " Hz (calibrated)\n",
+		         swdp_calibrated_frequency);
+#endif
 
 	return true;
 }
@@ -263,6 +298,27 @@ bool parse_enable_or_disable(const char *s, bool *out) {
 	}
 }
 
+bool parse_frequency(const char *s, uint32_t *freq)
+{
+	char *end;
+	unsigned long f = strtoul(s, &end, 0);
+	unsigned long mult = 1;
+
+	if (end == s)
+		return false;
+	if (*end == 'k') {
+		mult = 1000;
+		end++;
+	} else if (*end == 'M') {
+		mult = 1000 * 1000;
+		end++;
+	}
+	if (*end || (f > UINT32_MAX / mult))
+		return false;
+	*freq = f * mult;
+	return true;
+}
+
 static bool cmd_connect_srst(target *t, int argc, const char **argv)
 {
 	(void)t;
@@ -294,6 +350,75 @@ static bool cmd_halt_timeout(target *t, int argc, const char **argv)
 	return true;
 }
 
+static bool cmd_halt_poll(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc == 3) {
+		halt_poll_min = strtoul(argv[1], NULL, 0);
+		halt_poll_max = strtoul(argv[2], NULL, 0);
+		if (halt_poll_max < halt_poll_min)
+			halt_poll_max = halt_poll_min;
+	} else if (argc != 1) {
+		gdb_outf("Unrecognized command format\n");
+		return true;
+	}
+	gdb_outf("Halt poll interval: %" PRIu32 " to %" PRIu32 " ms\n",
+	         halt_poll_min, halt_poll_max);
+	gdb_outf("%" PRIu32 " polls in %" PRIu32 " runs, %" PRIu32 " ms running\n",
+	         halt_poll_stats.polls, halt_poll_stats.runs,
+	         halt_poll_stats.run_time);
+	gdb_outf("Last run: %" PRIu32 " polls, %" PRIu32 " ms\n",
+	         halt_poll_stats.last_polls, halt_poll_stats.last_run_time);
+	return true;
+}
+
+static bool cmd_semihosting_console(target *t, int argc, const char **argv)
+{
+	(void)t;
+	static const char *const names[] = {
+		[HOSTIO_CONSOLE_GDB] = "gdb",
+		[HOSTIO_CONSOLE_PROBE] = "probe",
+#if defined(LIBFTDI)
+		[HOSTIO_CONSOLE_STDOUT] = "stdout",
+#endif
+	};
+	if (argc == 2) {
+		unsigned i;
+		for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+			if (!strcmp(argv[1], names[i]))
+				break;
+		if (i == sizeof(names) / sizeof(names[0])) {
+			gdb_outf("Argument '%s' not recognized\n", argv[1]);
+			return true;
+		}
+		hostio_console = i;
+	} else if (argc != 1) {
+		gdb_outf("Unrecognized command format\n");
+		return true;
+	}
+	gdb_outf("Semihosting console: %s\n", names[hostio_console]);
+	return true;
+}
+
+#if defined(LIBFTDI)
+static bool cmd_semihosting_dir(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc == 2) {
+		if (!hostio_fs_set_dir(strcmp(argv[1], "gdb") ? argv[1] : NULL))
+			gdb_outf("Out of memory\n");
+	} else if (argc != 1) {
+		gdb_outf("Unrecognized command format\n");
+		return true;
+	}
+	if (hostio_fs_dir())
+		gdb_outf("Semihosting files in: %s\n", hostio_fs_dir());
+	else
+		gdb_outf("Semihosting files through GDB\n");
+	return true;
+}
+#endif
+
 static bool cmd_hard_srst(void)
 {
 	target_list_free();
@@ -364,3 +489,51 @@ static bool cmd_debug_bmp(target *t, int argc, const char **argv)
 	return true;
 }
 #endif
+
+#ifdef PLATFORM_HAS_FREQUENCY
+static bool cmd_frequency(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc == 2) {
+		uint32_t freq;
+		if (!parse_frequency(argv[1], &freq)) {
+			gdb_outf("Frequency '%s' not recognized, use Hz, k or M\n",
+			         argv[1]);
+			return true;
+		}
+		platform_max_frequency_set(freq);
+		/* No longer the calibrated clock shown by "targets" */
+		swdp_calibrated_frequency = 0;
+	} else if (argc > 2) {
+		gdb_outf("Unrecognized command format\n");
+		return true;
+	}
+	uint32_t freq = platform_max_frequency_get();
+	if (freq)
+		gdb_outf("Max frequency: %" PRIu32 " Hz\n", freq);
+	else
+		gdb_outf("Max frequency: interface default\n");
+	return true;
+}
+
+static bool cmd_swdp_calibrate(target *t, int argc, const char **argv)
+{
+	(void)t;
+	bool print_status = false;
+	if (argc == 1) {
+		print_status = true;
+	} else if (argc == 2) {
+		if (parse_enable_or_disable(argv[1], &swdp_calibrate)) {
+			print_status = true;
+		}
+	} else {
+		gdb_outf("Unrecognized command format\n");
+	}
+
+	if (print_status) {
+		gdb_outf("SWD clock calibration on attach: %s\n",
+			 swdp_calibrate ? "enabled" : "disabled");
+	}
+	return true;
+}
+#endif
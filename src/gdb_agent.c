@@ -0,0 +1,379 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements an interpreter for GDB agent expressions, so
+ * breakpoint conditions can be evaluated without a round trip to GDB.
+ * See "Agent Expressions" in the GDB manual for the bytecode.
+ */
+
+#include "general.h"
+#include "target.h"
+#include "hex_utils.h"
+#include "gdb_agent.h"
+
+enum agent_op {
+	AX_ADD = 0x02,
+	AX_SUB = 0x03,
+	AX_MUL = 0x04,
+	AX_DIV_SIGNED = 0x05,
+	AX_DIV_UNSIGNED = 0x06,
+	AX_REM_SIGNED = 0x07,
+	AX_REM_UNSIGNED = 0x08,
+	AX_LSH = 0x09,
+	AX_RSH_SIGNED = 0x0a,
+	AX_RSH_UNSIGNED = 0x0b,
+	AX_LOG_NOT = 0x0e,
+	AX_BIT_AND = 0x0f,
+	AX_BIT_OR = 0x10,
+	AX_BIT_XOR = 0x11,
+	AX_BIT_NOT = 0x12,
+	AX_EQUAL = 0x13,
+	AX_LESS_SIGNED = 0x14,
+	AX_LESS_UNSIGNED = 0x15,
+	AX_EXT = 0x16,
+	AX_REF8 = 0x17,
+	AX_REF16 = 0x18,
+	AX_REF32 = 0x19,
+	AX_REF64 = 0x1a,
+	AX_IF_GOTO = 0x20,
+	AX_GOTO = 0x21,
+	AX_CONST8 = 0x22,
+	AX_CONST16 = 0x23,
+	AX_CONST32 = 0x24,
+	AX_CONST64 = 0x25,
+	AX_REG = 0x26,
+	AX_END = 0x27,
+	AX_DUP = 0x28,
+	AX_POP = 0x29,
+	AX_ZERO_EXT = 0x2a,
+	AX_SWAP = 0x2b,
+	AX_PICK = 0x32,
+	AX_ROT = 0x33,
+};
+
+#define AGENT_STACK_SIZE	32
+/* Guards against expressions that loop forever */
+#define AGENT_MAX_STEPS		1000
+
+/* Immediate operands are big-endian */
+static uint64_t agent_imm(const uint8_t *code, size_t len, size_t *pc,
+                          unsigned size, bool *ok)
+{
+	uint64_t val = 0;
+	if (*pc + size > len) {
+		*ok = false;
+		return 0;
+	}
+	while (size--)
+		val = (val << 8) | code[(*pc)++];
+	return val;
+}
+
+bool gdb_agent_eval(target *t, const uint8_t *code, size_t len,
+                    int64_t *result)
+{
+	uint64_t stack[AGENT_STACK_SIZE];
+	unsigned sp = 0;
+	size_t pc = 0;
+	bool ok = true;
+
+	/* Operand counts are checked before each op */
+#define NEED(n)		if (sp < (n)) return false
+#define ROOM(n)		if (sp + (n) > AGENT_STACK_SIZE) return false
+#define TOP		stack[sp - 1]
+#define NEXT		stack[sp - 2]
+
+	for (unsigned steps = 0; steps < AGENT_MAX_STEPS; steps++) {
+		if (pc >= len)
+			return false;
+		uint8_t op = code[pc++];
+		uint64_t a, b;
+
+		switch (op) {
+		case AX_ADD: NEED(2); NEXT += TOP; sp--; break;
+		case AX_SUB: NEED(2); NEXT -= TOP; sp--; break;
+		case AX_MUL: NEED(2); NEXT *= TOP; sp--; break;
+		case AX_DIV_SIGNED:
+		case AX_DIV_UNSIGNED:
+		case AX_REM_SIGNED:
+		case AX_REM_UNSIGNED:
+			NEED(2);
+			a = NEXT; b = TOP; sp--;
+			if (b == 0)
+				return false;
+			if (op == AX_DIV_SIGNED)
+				TOP = (int64_t)a / (int64_t)b;
+			else if (op == AX_DIV_UNSIGNED)
+				TOP = a / b;
+			else if (op == AX_REM_SIGNED)
+				TOP = (int64_t)a % (int64_t)b;
+			else
+				TOP = a % b;
+			break;
+		case AX_LSH: NEED(2); NEXT <<= TOP; sp--; break;
+		case AX_RSH_SIGNED:
+			NEED(2); NEXT = (int64_t)NEXT >> TOP; sp--; break;
+		case AX_RSH_UNSIGNED: NEED(2); NEXT >>= TOP; sp--; break;
+		case AX_LOG_NOT: NEED(1); TOP = !TOP; break;
+		case AX_BIT_AND: NEED(2); NEXT &= TOP; sp--; break;
+		case AX_BIT_OR: NEED(2); NEXT |= TOP; sp--; break;
+		case AX_BIT_XOR: NEED(2); NEXT ^= TOP; sp--; break;
+		case AX_BIT_NOT: NEED(1); TOP = ~TOP; break;
+		case AX_EQUAL: NEED(2); NEXT = NEXT == TOP; sp--; break;
+		case AX_LESS_SIGNED:
+			NEED(2); NEXT = (int64_t)NEXT < (int64_t)TOP; sp--; break;
+		case AX_LESS_UNSIGNED: NEED(2); NEXT = NEXT < TOP; sp--; break;
+		case AX_EXT:
+		case AX_ZERO_EXT: {
+			unsigned bits = agent_imm(code, len, &pc, 1, &ok);
+			NEED(1);
+			if (!ok || bits == 0)
+				return false;
+			if (bits >= 64)
+				break;
+			uint64_t mask = (1ULL << bits) - 1;
+			TOP &= mask;
+			if ((op == AX_EXT) && (TOP & (1ULL << (bits - 1))))
+				TOP |= ~mask;
+			break;
+			}
+		case AX_REF8:
+		case AX_REF16:
+		case AX_REF32:
+		case AX_REF64: {
+			unsigned size = 1 << (op - AX_REF8);
+			uint64_t val = 0;
+			NEED(1);
+			if (target_mem_read(t, &val, TOP, size))
+				return false;
+			TOP = val;
+			break;
+			}
+		case AX_IF_GOTO:
+			a = agent_imm(code, len, &pc, 2, &ok);
+			NEED(1);
+			if (TOP)
+				pc = a;
+			sp--;
+			break;
+		case AX_GOTO:
+			pc = agent_imm(code, len, &pc, 2, &ok);
+			break;
+		case AX_CONST8:
+		case AX_CONST16:
+		case AX_CONST32:
+		case AX_CONST64:
+			a = agent_imm(code, len, &pc, 1 << (op - AX_CONST8), &ok);
+			ROOM(1);
+			stack[sp++] = a;
+			break;
+		case AX_REG: {
+			uint64_t val = 0;
+			int reg = agent_imm(code, len, &pc, 2, &ok);
+			ROOM(1);
+			if (!ok || (target_reg_read(t, reg, &val, sizeof(val)) <= 0))
+				return false;
+			stack[sp++] = val;
+			break;
+			}
+		case AX_END:
+			NEED(1);
+			*result = TOP;
+			return true;
+		case AX_DUP: NEED(1); ROOM(1); stack[sp] = TOP; sp++; break;
+		case AX_POP: NEED(1); sp--; break;
+		case AX_SWAP: NEED(2); a = TOP; TOP = NEXT; NEXT = a; break;
+		case AX_PICK:
+			a = agent_imm(code, len, &pc, 1, &ok);
+			NEED(a + 1);
+			ROOM(1);
+			stack[sp] = stack[sp - 1 - a];
+			sp++;
+			break;
+		case AX_ROT:
+			/* a b c => c a b */
+			NEED(3);
+			a = TOP;
+			TOP = NEXT;
+			NEXT = stack[sp - 3];
+			stack[sp - 3] = a;
+			break;
+		default:
+			/* Floating point, tracing and state variables */
+			DEBUG("Unsupported agent bytecode 0x%02X\n", op);
+			return false;
+		}
+		if (!ok)
+			return false;
+	}
+	return false;
+#undef NEED
+#undef ROOM
+#undef TOP
+#undef NEXT
+}
+
+struct bp_cond {
+	struct bp_cond *next;
+	enum target_breakwatch type;
+	target_addr addr;
+	size_t len;
+	size_t code_len;
+	uint8_t code[];
+};
+
+static struct bp_cond *bp_conds;
+
+bool gdb_bp_cond_add(enum target_breakwatch type, target_addr addr,
+                     size_t len, const char *hex, size_t code_len)
+{
+	struct bp_cond *c = malloc(sizeof(*c) + code_len);
+	if (!c)
+		return false;
+	c->type = type;
+	c->addr = addr;
+	c->len = len;
+	c->code_len = code_len;
+	unhexify(c->code, hex, code_len);
+	c->next = bp_conds;
+	bp_conds = c;
+	return true;
+}
+
+/* Returns true if there were conditions for addr */
+bool gdb_bp_cond_clear(target_addr addr)
+{
+	struct bp_cond **p = &bp_conds;
+	bool found = false;
+
+	while (*p) {
+		struct bp_cond *c = *p;
+		if (c->addr == addr) {
+			*p = c->next;
+			free(c);
+			found = true;
+		} else {
+			p = &c->next;
+		}
+	}
+	return found;
+}
+
+void gdb_bp_cond_clear_all(void)
+{
+	while (bp_conds) {
+		struct bp_cond *next = bp_conds->next;
+		free(bp_conds);
+		bp_conds = next;
+	}
+}
+
+/* True only if addr has conditions and every one of them evaluates to
+ * false, in which case the target should carry on. An expression we
+ * can't evaluate counts as true so GDB gets to see the stop. */
+bool gdb_bp_cond_false(target *t, target_addr addr)
+{
+	bool found = false;
+
+	for (struct bp_cond *c = bp_conds; c; c = c->next) {
+		int64_t result;
+		if (c->addr != addr)
+			continue;
+		if (!gdb_agent_eval(t, c->code, c->code_len, &result) || result)
+			return false;
+		found = true;
+	}
+	return found;
+}
+
+/* Break-/watchpoints inserted by GDB, as opposed to the ones the
+ * tracepoints share with it in the target's list */
+struct gdb_bw {
+	struct gdb_bw *next;
+	enum target_breakwatch type;
+	target_addr addr;
+	size_t len;
+};
+
+static struct gdb_bw *gdb_bws;
+
+static struct gdb_bw **gdb_bw_find(enum target_breakwatch type,
+                                   target_addr addr, size_t len)
+{
+	struct gdb_bw **p;
+
+	for (p = &gdb_bws; *p; p = &(*p)->next)
+		if (((*p)->type == type) && ((*p)->addr == addr) &&
+		    ((*p)->len == len))
+			break;
+	return p;
+}
+
+bool gdb_bw_owned(enum target_breakwatch type, target_addr addr, size_t len)
+{
+	return *gdb_bw_find(type, addr, len) != NULL;
+}
+
+bool gdb_bw_add(enum target_breakwatch type, target_addr addr, size_t len)
+{
+	struct gdb_bw *bw = malloc(sizeof(*bw));
+	if (!bw)
+		return false;
+	bw->type = type;
+	bw->addr = addr;
+	bw->len = len;
+	bw->next = gdb_bws;
+	gdb_bws = bw;
+	return true;
+}
+
+/* Returns true if GDB had inserted it */
+bool gdb_bw_remove(enum target_breakwatch type, target_addr addr, size_t len)
+{
+	struct gdb_bw **p = gdb_bw_find(type, addr, len);
+	struct gdb_bw *bw = *p;
+
+	if (!bw)
+		return false;
+	*p = bw->next;
+	free(bw);
+	return true;
+}
+
+/* Forgets GDB's break-/watchpoints, also removing them from t unless
+ * it has already dropped them */
+void gdb_bw_clear_all(target *t)
+{
+	while (gdb_bws) {
+		struct gdb_bw *next = gdb_bws->next;
+		if (t)
+			target_breakwatch_clear(t, gdb_bws->type,
+			                        gdb_bws->addr, gdb_bws->len);
+		free(gdb_bws);
+		gdb_bws = next;
+	}
+}
+
+/* True if GDB has a breakpoint of its own at addr */
+bool gdb_bp_at(target_addr addr)
+{
+	for (struct gdb_bw *bw = gdb_bws; bw; bw = bw->next)
+		if ((bw->addr == addr) && ((bw->type == TARGET_BREAK_SOFT) ||
+		                           (bw->type == TARGET_BREAK_HARD)))
+			return true;
+	return false;
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __GDB_AGENT_H
+#define __GDB_AGENT_H
+
+#include "target.h"
+
+/* Evaluate a GDB agent expression against a halted target.
+ * Returns false if the expression can't be evaluated. */
+bool gdb_agent_eval(target *t, const uint8_t *code, size_t len,
+                    int64_t *result);
+
+/* Breakpoint conditions, as sent with Z packets */
+bool gdb_bp_cond_add(enum target_breakwatch type, target_addr addr,
+                     size_t len, const char *hex, size_t code_len);
+bool gdb_bp_cond_clear(target_addr addr);
+void gdb_bp_cond_clear_all(void);
+bool gdb_bp_cond_false(target *t, target_addr addr);
+
+/* Break-/watchpoints GDB owns, the target's may also be tracepoints */
+bool gdb_bw_owned(enum target_breakwatch type, target_addr addr, size_t len);
+bool gdb_bw_add(enum target_breakwatch type, target_addr addr, size_t len);
+bool gdb_bw_remove(enum target_breakwatch type, target_addr addr, size_t len);
+void gdb_bw_clear_all(target *t);
+bool gdb_bp_at(target_addr addr);
+
+#endif
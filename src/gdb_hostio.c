@@ -23,9 +23,12 @@
 #include "gdb_main.h"
 #include "gdb_hostio.h"
 #include "gdb_packet.h"
+#include "hex_utils.h"
 
 int gdb_main_loop(struct target_controller *, bool in_syscall);
 
+enum hostio_console hostio_console = HOSTIO_CONSOLE_GDB;
+
 int hostio_reply(struct target_controller *tc, char *pbuf, int len)
 {
 	(void)len;
@@ -131,3 +134,27 @@ int hostio_system(struct target_controller *tc,
 	return gdb_main_loop(tc, true);
 }
 
+/* Console output is sent without waiting for GDB, so the target can
+ * resume straight away. */
+int hostio_console_write(struct target_controller *tc,
+                         const void *buf, unsigned int count)
+{
+	(void)tc;
+	switch (hostio_console) {
+	case HOSTIO_CONSOLE_PROBE: {
+		char packet[2 + count * 2];
+		packet[0] = 'O';
+		hexify(packet + 1, buf, count);
+		gdb_putpacket(packet, 1 + count * 2);
+		return count;
+		}
+#if defined(LIBFTDI)
+	case HOSTIO_CONSOLE_STDOUT:
+		fwrite(buf, 1, count, stdout);
+		fflush(stdout);
+		return count;
+#endif
+	default:
+		return -1;
+	}
+}
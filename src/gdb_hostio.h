@@ -24,6 +24,16 @@
 
 int hostio_reply(struct target_controller *tc, char *packet, int len);
 
+/* Where semihosting console output goes */
+enum hostio_console {
+	HOSTIO_CONSOLE_GDB,	/* F packets, GDB reads the data */
+	HOSTIO_CONSOLE_PROBE,	/* O packets sent by the probe */
+#if defined(LIBFTDI)
+	HOSTIO_CONSOLE_STDOUT,	/* The probe process' stdout */
+#endif
+};
+extern enum hostio_console hostio_console;
+
 /* Interface to host system calls */
 int hostio_open(struct target_controller *,
 	        target_addr path, size_t path_len,
@@ -48,6 +58,8 @@ int hostio_gettimeofday(struct target_controller *,
 int hostio_isatty(struct target_controller *, int fd);
 int hostio_system(struct target_controller *,
 	           target_addr cmd, size_t cmd_len);
+int hostio_console_write(struct target_controller *,
+                         const void *buf, unsigned int count);
 
 #endif
 
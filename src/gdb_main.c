@@ -30,28 +30,64 @@
 #include "gdb_packet.h"
 #include "gdb_main.h"
 #include "gdb_hostio.h"
+#if defined(LIBFTDI)
+#	include "hostio_fs.h"
+#endif
+#include "gdb_agent.h"
+#include "gdb_trace.h"
 #include "target.h"
 #include "command.h"
 #include "crc32.h"
 #include "morse.h"
 
 enum gdb_signal {
+	GDB_SIG0 = 0,
 	GDB_SIGINT = 2,
 	GDB_SIGTRAP = 5,
 	GDB_SIGSEGV = 11,
 	GDB_SIGLOST = 29,
 };
 
-#define BUF_SIZE	1024
+/* GDB register number of the PC in the ARM target descriptions */
+#define REGNUM_PC	15
+
+/* Platforms with memory to spare may raise this to cut down on round
+ * trips, it is advertised to GDB as PacketSize. */
+#ifndef GDB_PACKET_BUFFER_SIZE
+#define GDB_PACKET_BUFFER_SIZE	1024
+#endif
+#define BUF_SIZE	GDB_PACKET_BUFFER_SIZE
 
 #define ERROR_IF_NO_TARGET()	\
 	if(!cur_target) { gdb_putpacketz("EFF"); break; }
 
+/* Registers can't be accessed while the core runs in non-stop mode */
+#define ERROR_IF_RUNNING()	\
+	if(running) { gdb_putpacketz("E01"); break; }
+
+#if defined(LIBFTDI)
+static char *pbuf;
+#else
 static char pbuf[BUF_SIZE+1];
+#endif
+
+struct halt_poll_stats halt_poll_stats;
 
 static target *cur_target;
 static target *last_target;
 
+/* Keep stepping while PC is within [range_start, range_end) */
+static uint32_t range_start, range_end;
+
+/* Non-stop mode: GDB is served while the target runs and stops are
+ * sent as notifications. */
+static bool non_stop;
+static bool running;
+static uint32_t run_start;	/* platform_time_ms() at the resume */
+static bool stop_requested;
+static enum target_halt_reason last_reason;
+static target_addr last_watch;
+
 static void handle_q_packet(char *packet, int len);
 static void handle_v_packet(char *packet, int len);
 static void handle_z_packet(char *packet, int len);
@@ -64,6 +100,10 @@ static void gdb_target_destroy_callback(struct target_controller *tc, target *t)
 
 	if (last_target == t)
 		last_target = NULL;
+	gdb_bw_clear_all(NULL);
+#if defined(LIBFTDI)
+	hostio_fs_close_all();
+#endif
 }
 
 static void gdb_target_printf(struct target_controller *tc,
@@ -77,6 +117,19 @@ static struct target_controller gdb_controller = {
 	.destroy_callback = gdb_target_destroy_callback,
 	.printf = gdb_target_printf,
 
+#if defined(LIBFTDI)
+	/* Files are served from a host directory once one is set */
+	.open = hostio_fs_open,
+	.close = hostio_fs_close,
+	.read = hostio_fs_read,
+	.write = hostio_fs_write,
+	.lseek = hostio_fs_lseek,
+	.rename = hostio_fs_rename,
+	.unlink = hostio_fs_unlink,
+	.stat = hostio_fs_stat,
+	.fstat = hostio_fs_fstat,
+	.isatty = hostio_fs_isatty,
+#else
 	.open = hostio_open,
 	.close = hostio_close,
 	.read = hostio_read,
@@ -86,18 +139,189 @@ static struct target_controller gdb_controller = {
 	.unlink = hostio_unlink,
 	.stat = hostio_stat,
 	.fstat = hostio_fstat,
-	.gettimeofday = hostio_gettimeofday,
 	.isatty = hostio_isatty,
+#endif
+	.gettimeofday = hostio_gettimeofday,
 	.system = hostio_system,
+	.console_write = hostio_console_write,
 };
 
+/* How long a step off a breakpoint may take, in ms */
+#define STEP_OVER_TIMEOUT	500
+
+/* Step off a tracepoint or a breakpoint whose condition is false and
+ * let the target run on.  Anything other than the step completing is reported. */
+static enum target_halt_reason gdb_bp_step_over(target_addr addr)
+{
+	enum target_halt_reason reason;
+	platform_timeout timeout;
+
+	/* Both GDB and a tracepoint may have a breakpoint here */
+	target_breakwatch_lift(cur_target, addr, true);
+	target_halt_resume(cur_target, true);
+	platform_timeout_set(&timeout, STEP_OVER_TIMEOUT);
+	while (!(reason = target_halt_poll(cur_target, NULL))) {
+		/* The step can hang, e.g. WFI with interrupts masked */
+		if (platform_timeout_is_expired(&timeout) ||
+		    (gdb_packet_wait(0) == '\x03')) {
+			target_halt_request(cur_target);
+			platform_timeout_set(&timeout, STEP_OVER_TIMEOUT);
+			while (!(reason = target_halt_poll(cur_target, NULL)))
+				if (platform_timeout_is_expired(&timeout))
+					return TARGET_HALT_ERROR;
+			if (reason == TARGET_HALT_STEPPING)
+				reason = TARGET_HALT_REQUEST;
+			break;
+		}
+	}
+	if (reason == TARGET_HALT_ERROR)
+		return reason;
+	target_breakwatch_lift(cur_target, addr, false);
+	if (reason != TARGET_HALT_STEPPING)
+		return reason;
+	target_halt_resume(cur_target, false);
+	return TARGET_HALT_RUNNING;
+}
+
+/* Poll for a halt, resuming range steps that are still in range,
+ * tracepoints and breakpoints whose conditions are false */
+static enum target_halt_reason gdb_halt_poll(target_addr *watch)
+{
+	/* The target is halted while a semihosting request is served from
+	 * inside target_halt_poll(), so the nested main loop mustn't wait
+	 * for it to stop. */
+	bool was_running = running;
+	running = false;
+	enum target_halt_reason reason = target_halt_poll(cur_target, watch);
+	running = was_running;
+	halt_poll_stats.last_polls++;
+
+	if (reason == TARGET_HALT_BREAKPOINT) {
+		uint32_t pc;
+		if (target_reg_read(cur_target, REGNUM_PC, &pc, sizeof(pc)) == sizeof(pc)) {
+			/* Collect first, GDB still sees the stop if it has a
+			 * breakpoint of its own here whose condition holds. */
+			bool traced = gdb_trace_hit(cur_target, pc);
+			bool gdb_bp = gdb_bp_at(pc);
+			if ((traced && !gdb_bp) ||
+			    (gdb_bp && gdb_bp_cond_false(cur_target, pc)))
+				reason = gdb_bp_step_over(pc);
+			if (traced)
+				gdb_trace_update(cur_target);
+		}
+	}
+
+	if (reason == TARGET_HALT_STEPPING && range_start != range_end) {
+		/* Range stepping, only stop once PC leaves the range. */
+		uint32_t pc;
+		if ((target_reg_read(cur_target, REGNUM_PC, &pc, sizeof(pc)) == sizeof(pc)) &&
+		    (pc >= range_start) && (pc < range_end)) {
+			target_halt_resume(cur_target, true);
+			return TARGET_HALT_RUNNING;
+		}
+	}
+	if (reason)
+		range_start = range_end = 0;
+	return reason;
+}
+
+static void gdb_stop_reply(enum target_halt_reason reason, target_addr watch,
+                           bool notify)
+{
+	/* Room for the "Stop:" prefix of a notification */
+	char buf[32];
+	char *reply = buf + 5;
+	size_t len = sizeof(buf) - 5;
+
+	/* Translate reason to GDB signal */
+	switch (reason) {
+	case TARGET_HALT_ERROR:
+		len = snprintf(reply, len, "X%02X", GDB_SIGLOST);
+		morse("TARGET LOST.", true);
+		break;
+	case TARGET_HALT_REQUEST:
+		len = snprintf(reply, len, "T%02X",
+		               stop_requested ? GDB_SIG0 : GDB_SIGINT);
+		break;
+	case TARGET_HALT_WATCHPOINT:
+		len = snprintf(reply, len, "T%02Xwatch:%08X;", GDB_SIGTRAP, watch);
+		break;
+	case TARGET_HALT_FAULT:
+		len = snprintf(reply, len, "T%02X", GDB_SIGSEGV);
+		break;
+	default:
+		len = snprintf(reply, len, "T%02X", GDB_SIGTRAP);
+	}
+
+	if (notify) {
+		memcpy(buf, "Stop:", 5);
+		gdb_putnotification(buf, len + 5);
+	} else {
+		gdb_putpacket(reply, len);
+	}
+}
+
+/* Account a finished run in the "halt_poll" statistics */
+static void gdb_halt_poll_stats(uint32_t start)
+{
+	halt_poll_stats.runs++;
+	halt_poll_stats.polls += halt_poll_stats.last_polls;
+	halt_poll_stats.last_run_time = platform_time_ms() - start;
+	halt_poll_stats.run_time += halt_poll_stats.last_run_time;
+}
+
+/* Non-stop mode: poll the running target until it stops or GDB starts
+ * sending a packet, whichever comes first. */
+static void gdb_nonstop_wait(void)
+{
+	uint32_t interval = halt_poll_min;
+
+	while (running && cur_target) {
+		target_addr watch;
+		enum target_halt_reason reason = gdb_halt_poll(&watch);
+		if (reason) {
+			running = false;
+			SET_RUN_STATE(0);
+			gdb_halt_poll_stats(run_start);
+			last_reason = reason;
+			last_watch = watch;
+			gdb_stop_reply(reason, watch, true);
+			stop_requested = false;
+			return;
+		}
+
+		unsigned char c = gdb_packet_wait(interval);
+		if (c == '$')
+			return;
+		if((c == '\x03') || (c == '\x04')) {
+			target_halt_request(cur_target);
+			range_start = range_end = 0;
+			interval = halt_poll_min;
+			continue;
+		}
+		interval = interval ? interval * 2 : 1;
+		if (interval > halt_poll_max)
+			interval = halt_poll_max;
+	}
+	running = false;
+}
+
 int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 {
 	int size;
 	bool single_step = false;
 
+#if defined(LIBFTDI)
+	if (!pbuf && !(pbuf = malloc(BUF_SIZE+1))) {
+		DEBUG("Can't allocate %d byte packet buffer\n", BUF_SIZE+1);
+		exit(-1);
+	}
+#endif
+
 	/* GDB protocol main loop */
 	while(1) {
+		if (running && !in_syscall)
+			gdb_nonstop_wait();
 		SET_IDLE_STATE(1);
 		size = gdb_getpacket(pbuf, BUF_SIZE);
 		SET_IDLE_STATE(0);
@@ -105,6 +329,12 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 		/* Implementation of these is mandatory! */
 		case 'g': { /* 'g': Read general registers */
 			ERROR_IF_NO_TARGET();
+			ERROR_IF_RUNNING();
+			if (gdb_trace_frame_selected()) {
+				gdb_trace_regs_read(cur_target, pbuf);
+				gdb_putpacketz(pbuf);
+				break;
+			}
 			uint8_t arm_regs[target_regs_size(cur_target)];
 			target_regs_read(cur_target, arm_regs);
 			gdb_putpacket(hexify(pbuf, arm_regs, sizeof(arm_regs)),
@@ -115,20 +345,94 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			uint32_t addr, len;
 			ERROR_IF_NO_TARGET();
 			sscanf(pbuf, "m%" SCNx32 ",%" SCNx32, &addr, &len);
-			if (len > sizeof(pbuf) / 2) {
+			if (len > BUF_SIZE / 2) {
 				gdb_putpacketz("E02");
 				break;
 			}
 			DEBUG("m packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			uint8_t mem[len];
-			if (target_mem_read(cur_target, mem, addr, len))
+			/* Read into the upper part of pbuf, hexify() never
+			 * overwrites data it has not consumed yet. */
+			char *mem = pbuf + len;
+			if (gdb_trace_frame_selected() ?
+			    gdb_trace_mem_read(mem, addr, len) :
+			    target_mem_read(cur_target, mem, addr, len))
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacket(hexify(pbuf, mem, len), len*2);
 			break;
 			}
+		case 'x': {	/* 'x addr,len': Read len bytes from addr in binary */
+			uint32_t addr, len;
+			ERROR_IF_NO_TARGET();
+			sscanf(pbuf, "x%" SCNx32 ",%" SCNx32, &addr, &len);
+			if (len > BUF_SIZE - 1) {
+				gdb_putpacketz("E02");
+				break;
+			}
+			DEBUG("x packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
+			/* Escaping is done by gdb_putpacket() */
+			pbuf[0] = 'b';
+			if (gdb_trace_frame_selected() ?
+			    gdb_trace_mem_read(pbuf + 1, addr, len) :
+			    target_mem_read(cur_target, pbuf + 1, addr, len))
+				gdb_putpacketz("E01");
+			else
+				gdb_putpacket(pbuf, len + 1);
+			break;
+			}
+		case 'p': {	/* 'p n': Read register n */
+			uint8_t val[8];
+			int reg = -1;
+			ERROR_IF_NO_TARGET();
+			ERROR_IF_RUNNING();
+			sscanf(pbuf, "p%x", &reg);
+			if (gdb_trace_frame_selected()) {
+				if (gdb_trace_reg_read(cur_target, reg, pbuf))
+					gdb_putpacketz(pbuf);
+				else
+					gdb_putpacketz("E01");
+				break;
+			}
+			ssize_t ret = target_reg_read(cur_target, reg, val, sizeof(val));
+			if (ret < 0)
+				gdb_putpacketz("E01");
+			else
+				gdb_putpacket(hexify(pbuf, val, ret), ret * 2);
+			break;
+			}
+		case 'P': {	/* 'P n=XX': Write register n */
+			uint8_t val[8];
+			int reg = -1, hex = size;
+			ERROR_IF_NO_TARGET();
+			ERROR_IF_RUNNING();
+			if (gdb_trace_frame_selected()) {
+				gdb_putpacketz("E01");
+				break;
+			}
+			sscanf(pbuf, "P%x=%n", &reg, &hex);
+			size_t len = (size - hex) / 2;
+			if (len > sizeof(val)) {
+				gdb_putpacketz("E02");
+				break;
+			}
+			unhexify(val, pbuf + hex, len);
+			ssize_t ret = target_reg_write(cur_target, reg, val, len);
+			if (ret < 0)
+				gdb_putpacketz("E01");
+			else if (ret == 0)
+				gdb_putpacketz("");
+			else
+				gdb_putpacketz("OK");
+			break;
+			}
 		case 'G': {	/* 'G XX': Write general registers */
 			ERROR_IF_NO_TARGET();
+			ERROR_IF_RUNNING();
+			/* Trace frames are read only */
+			if (gdb_trace_frame_selected()) {
+				gdb_putpacketz("E01");
+				break;
+			}
 			uint8_t arm_regs[target_regs_size(cur_target)];
 			unhexify(arm_regs, &pbuf[1], sizeof(arm_regs));
 			target_regs_write(cur_target, arm_regs);
@@ -145,18 +449,45 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("M packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			uint8_t mem[len];
-			unhexify(mem, pbuf + hex, len);
-			if (target_mem_write(cur_target, addr, mem, len))
+			/* Decode in place, the binary data is half the size */
+			unhexify(pbuf, pbuf + hex, len);
+			if (target_mem_write(cur_target, addr, pbuf, len))
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacketz("OK");
 			break;
 			}
-		case 's':	/* 's [addr]': Single step [start at addr] */
-			single_step = true;
+		case 'v':	/* General query packet */
+			if (strncmp(pbuf, "vCont;", 6) != 0) {
+				handle_v_packet(pbuf, size);
+				break;
+			}
+			if (pbuf[6] == 't') {
+				/* Non-stop interrupt, the stop is notified */
+				if (cur_target && running) {
+					target_halt_request(cur_target);
+					stop_requested = true;
+				}
+				gdb_putpacketz("OK");
+				break;
+			}
+			/* There's only one thread, the first action is ours */
+			switch (pbuf[6]) {
+			case 'r':
+				if (sscanf(pbuf, "vCont;r%" SCNx32 ",%" SCNx32,
+				           &range_start, &range_end) != 2)
+					range_start = range_end = 0;
+				/* fall through */
+			case 's':
+			case 'S':
+				single_step = true;
+				break;
+			}
 			/* fall through */
+		case 's':	/* 's [addr]': Single step [start at addr] */
 		case 'c':	/* 'c [addr]': Continue [at addr] */
+			if (pbuf[0] == 's')
+				single_step = true;
 			if(!cur_target) {
 				gdb_putpacketz("X1D");
 				break;
@@ -165,6 +496,14 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			target_halt_resume(cur_target, single_step);
 			SET_RUN_STATE(1);
 			single_step = false;
+			if (non_stop) {
+				/* The stop is sent as a notification */
+				running = true;
+				run_start = platform_time_ms();
+				halt_poll_stats.last_polls = 0;
+				gdb_putpacketz("OK");
+				break;
+			}
 			/* fall through */
 		case '?': {	/* '?': Request reason for target halt */
 			/* This packet isn't documented as being mandatory,
@@ -178,33 +517,43 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 
-			/* Wait for target halt */
-			while(!(reason = target_halt_poll(cur_target, &watch))) {
-				unsigned char c = gdb_if_getchar_to(0);
+			if (non_stop) {
+				/* Only report a stop GDB hasn't been told about */
+				if (running)
+					gdb_putpacketz("OK");
+				else
+					gdb_stop_reply(last_reason, last_watch, false);
+				break;
+			}
+
+			/* Wait for target halt.  Poll quickly at first, then
+			 * back off so a long run doesn't hog the debug bus.
+			 * Waiting for Ctrl-C provides the delay. */
+			uint32_t interval = halt_poll_min;
+			uint32_t start = platform_time_ms();
+			halt_poll_stats.last_polls = 0;
+			while(1) {
+				reason = gdb_halt_poll(&watch);
+				if (reason)
+					break;
+				unsigned char c = gdb_if_getchar_to(interval);
 				if((c == '\x03') || (c == '\x04')) {
 					target_halt_request(cur_target);
+					range_start = range_end = 0;
+					/* Poll again right away for the stop */
+					interval = halt_poll_min;
+					continue;
 				}
+				interval = interval ? interval * 2 : 1;
+				if (interval > halt_poll_max)
+					interval = halt_poll_max;
 			}
+			gdb_halt_poll_stats(start);
 			SET_RUN_STATE(0);
 
-			/* Translate reason to GDB signal */
-			switch (reason) {
-			case TARGET_HALT_ERROR:
-				gdb_putpacket_f("X%02X", GDB_SIGLOST);
-				morse("TARGET LOST.", true);
-				break;
-			case TARGET_HALT_REQUEST:
-				gdb_putpacket_f("T%02X", GDB_SIGINT);
-				break;
-			case TARGET_HALT_WATCHPOINT:
-				gdb_putpacket_f("T%02Xwatch:%08X;", GDB_SIGTRAP, watch);
-				break;
-			case TARGET_HALT_FAULT:
-				gdb_putpacket_f("T%02X", GDB_SIGSEGV);
-				break;
-			default:
-				gdb_putpacket_f("T%02X", GDB_SIGTRAP);
-			}
+			last_reason = reason;
+			last_watch = watch;
+			gdb_stop_reply(reason, watch, false);
 			break;
 			}
 		case 'F':	/* Semihosting call finished */
@@ -229,18 +578,33 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 		case 'D':	/* GDB 'detach' command. */
 			if(cur_target)
 				target_detach(cur_target);
+			gdb_trace_detach();
+			gdb_bp_cond_clear_all();
+			gdb_bw_clear_all(NULL);
+#if defined(LIBFTDI)
+			hostio_fs_close_all();
+#endif
 			last_target = cur_target;
 			cur_target = NULL;
 			gdb_putpacketz("OK");
+			/* The session is over, the next starts with acks */
+			gdb_set_noackmode(false);
 			break;
 
 		case 'k':	/* Kill the target */
 			if(cur_target) {
 				target_reset(cur_target);
 				target_detach(cur_target);
+				gdb_trace_detach();
+				gdb_bp_cond_clear_all();
+				gdb_bw_clear_all(NULL);
+#if defined(LIBFTDI)
+				hostio_fs_close_all();
+#endif
 				last_target = cur_target;
 				cur_target = NULL;
 			}
+			gdb_set_noackmode(false);
 			break;
 
 		case 'r':	/* Reset the target system */
@@ -271,13 +635,11 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 			break;
 			}
 
+		case 'Q':	/* General set packet */
 		case 'q':	/* General query packet */
 			handle_q_packet(pbuf, size);
 			break;
 
-		case 'v':	/* General query packet */
-			handle_v_packet(pbuf, size);
-			break;
 
 		/* These packet implement hardware break-/watchpoints */
 		case 'Z':	/* Z type,addr,len: Set breakpoint packet */
@@ -302,6 +664,8 @@ handle_q_string_reply(const char *str, const char *param)
 		gdb_putpacketz("E01");
 		return;
 	}
+	if (len > BUF_SIZE - 1)
+		len = BUF_SIZE - 1;
 	if (addr < strlen (str)) {
 		char reply[len+2];
 		reply[0] = 'm';
@@ -315,6 +679,70 @@ handle_q_string_reply(const char *str, const char *param)
 		gdb_putpacketz("E01");
 }
 
+#if defined(LIBFTDI)
+#define SEARCH_CHUNK	0x10000
+#else
+#define SEARCH_CHUNK	256
+#endif
+
+/* 'qSearch:memory:addr;len;pattern': Search memory on the probe, so
+ * GDB needn't read it all.  Blocks overlap by the pattern length, a
+ * match can't be missed at a boundary. */
+static void
+handle_q_search(const char *packet, int len)
+{
+	uint32_t addr, alen;
+	int n = 0;
+
+	if ((sscanf(packet, "qSearch:memory:%" SCNx32 ";%" SCNx32 ";%n",
+	            &addr, &alen, &n) != 2) || !n) {
+		gdb_putpacketz("E01");
+		return;
+	}
+	const uint8_t *pattern = (const uint8_t *)packet + n;
+	size_t plen = len - n;
+	if (!plen || (plen > SEARCH_CHUNK)) {
+		/* GDB searches itself */
+		gdb_putpacketz("");
+		return;
+	}
+
+#if defined(LIBFTDI)
+	static uint8_t *buf;
+	if (!buf && !(buf = malloc(SEARCH_CHUNK * 2))) {
+		gdb_putpacketz("E01");
+		return;
+	}
+#else
+	uint8_t buf[SEARCH_CHUNK * 2];
+#endif
+	size_t kept = 0;	/* Bytes carried over from the last block */
+	uint32_t base = addr;	/* Address of buf[0] */
+
+	while (alen + kept >= plen) {
+		size_t chunk = MIN(alen, (uint32_t)SEARCH_CHUNK);
+		if (target_mem_read(cur_target, buf + kept, base + kept, chunk)) {
+			gdb_putpacketz("E01");
+			return;
+		}
+		size_t avail = kept + chunk;
+		/* Candidates by first byte, then compare the rest */
+		const uint8_t *p = buf, *end = buf + avail - plen + 1;
+		while ((p < end) && (p = memchr(p, pattern[0], end - p))) {
+			if (!memcmp(p, pattern, plen)) {
+				gdb_putpacket_f("1,%" PRIx32, base + (uint32_t)(p - buf));
+				return;
+			}
+			p++;
+		}
+		alen -= chunk;
+		kept = MIN(avail, plen - 1);
+		memmove(buf, buf + avail - kept, kept);
+		base += avail - kept;
+	}
+	gdb_putpacketz("0");
+}
+
 static void
 handle_q_packet(char *packet, int len)
 {
@@ -340,8 +768,27 @@ handle_q_packet(char *packet, int len)
 			gdb_putpacketz("E");
 
 	} else if (!strncmp (packet, "qSupported", 10)) {
-		/* Query supported protocol features */
-		gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+", BUF_SIZE);
+		/* Query supported protocol features, a new session
+		 * always starts out acknowledging packets. */
+		gdb_set_noackmode(false);
+		non_stop = false;
+		gdb_bp_cond_clear_all();
+		gdb_bw_clear_all(cur_target);
+		gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+;binary-upload+;QStartNoAckMode+;QNonStop+;ConditionalBreakpoints+", BUF_SIZE);
+
+	} else if (!strncmp(packet, "QNonStop:", 9)) {
+		/* Switching modes while the target runs isn't supported */
+		if (running) {
+			gdb_putpacketz("E01");
+		} else {
+			non_stop = packet[9] == '1';
+			gdb_putpacketz("OK");
+		}
+
+	} else if (!strcmp(packet, "QStartNoAckMode")) {
+		/* GDB acknowledges this reply, stop acking after it */
+		gdb_putpacketz("OK");
+		gdb_set_noackmode(true);
 
 	} else if (strncmp (packet, "qXfer:memory-map:read::", 23) == 0) {
 		/* Read target XML memory map */
@@ -377,6 +824,15 @@ handle_q_packet(char *packet, int len)
 		}
 		gdb_putpacket_f("C%lx", generic_crc32(cur_target, addr, alen));
 
+	} else if (!strncmp(packet, "qSearch:memory:", 15)) {
+		if (!cur_target) {
+			gdb_putpacketz("E01");
+			return;
+		}
+		handle_q_search(packet, len);
+
+	} else if (gdb_trace_packet(cur_target, packet)) {
+		/* Tracepoint packets */
 	} else {
 		DEBUG("*** Unsupported packet: %s\n", packet);
 		gdb_putpacket("", 0);
@@ -398,6 +854,14 @@ handle_v_packet(char *packet, int plen)
 		else
 			gdb_putpacketz("E01");
 
+	} else if (!strcmp(packet, "vCont?")) {
+		/* Resume actions handled in gdb_main_loop() */
+		gdb_putpacketz("vCont;c;C;s;S;t;r");
+
+	} else if (!strcmp(packet, "vStopped")) {
+		/* Only one thread, there's never another stop queued */
+		gdb_putpacketz("OK");
+
 	} else if (!strcmp(packet, "vRun;")) {
 		/* Run target program. For us (embedded) this means reset. */
 		if(cur_target) {
@@ -466,10 +930,43 @@ handle_z_packet(char *packet, int plen)
 	//sscanf(packet, "%*[zZ]%hhd,%08lX,%hhd", &type, &addr, &len);
 	type = packet[1] - '0';
 	sscanf(packet + 2, ",%" PRIx32 ",%d", &addr, &len);
-	if(set)
-		ret = target_breakwatch_set(cur_target, type, addr, len);
-	else
-		ret = target_breakwatch_clear(cur_target, type, addr, len);
+	if(set) {
+		/* GDB resends Z to update the conditions of an inserted
+		 * breakpoint, only the first one reaches the target. */
+		gdb_bp_cond_clear(addr);
+		if (gdb_bw_owned(type, addr, len)) {
+			ret = 0;
+		} else {
+			ret = target_breakwatch_set(cur_target, type, addr, len);
+			if ((ret == 0) && !gdb_bw_add(type, addr, len)) {
+				target_breakwatch_clear(cur_target, type, addr, len);
+				ret = -1;
+			}
+		}
+	} else {
+		/* A tracepoint may share it, leave that one be */
+		gdb_bp_cond_clear(addr);
+		if (gdb_bw_remove(type, addr, len))
+			ret = target_breakwatch_clear(cur_target, type, addr, len);
+		else
+			ret = -1;
+	}
+
+	/* Conditions follow as ';X len,expr' */
+	char *cond = strchr(packet, ';');
+	while (set && (ret == 0) && cond && (cond[1] == 'X')) {
+		char *expr;
+		unsigned long code_len = strtoul(cond + 2, &expr, 16);
+		if ((*expr != ',') || (strlen(expr + 1) < code_len * 2) ||
+		    !gdb_bp_cond_add(type, addr, len, expr + 1, code_len)) {
+			gdb_bp_cond_clear(addr);
+			gdb_bw_remove(type, addr, len);
+			target_breakwatch_clear(cur_target, type, addr, len);
+			ret = -1;
+			break;
+		}
+		cond = strchr(expr + 1, ';');
+	}
 
 	if (ret < 0) {
 		gdb_putpacketz("E01");
@@ -29,6 +29,51 @@
 
 #include <stdarg.h>
 
+/* Set once GDB agrees to QStartNoAckMode, the transport is trusted */
+static bool noackmode;
+
+void gdb_set_noackmode(bool enable)
+{
+	noackmode = enable;
+}
+
+/* Set when gdb_packet_wait() has already consumed the '$' */
+static bool packet_started;
+
+unsigned char gdb_packet_wait(int timeout)
+{
+	unsigned char c = gdb_if_getchar_to(timeout);
+	if (c == '$')
+		packet_started = true;
+	return c;
+}
+
+#if defined(LIBFTDI)
+/* Copy the run of plain packet data that is already buffered by the
+ * interface, stopping before any character needing special handling.
+ */
+static int gdb_getpacket_run(char *packet, int size, unsigned char *csum)
+{
+	const unsigned char *buf, *stop;
+	int len = gdb_if_peek(&buf);
+
+	if(len > size)
+		len = size;
+	if((stop = memchr(buf, '#', len)))
+		len = stop - buf;
+	if((stop = memchr(buf, '}', len)))
+		len = stop - buf;
+	if((stop = memchr(buf, '$', len)))
+		len = stop - buf;
+
+	memcpy(packet, buf, len);
+	for(int j = 0; j < len; j++)
+		*csum += buf[j];
+	gdb_if_consume(len);
+	return len;
+}
+#endif
+
 int gdb_getpacket(char *packet, int size)
 {
 	unsigned char c;
@@ -38,12 +83,20 @@ int gdb_getpacket(char *packet, int size)
 
 	while(1) {
 		/* Wait for packet start */
-		while((packet[0] = gdb_if_getchar()) != '$')
-			if(packet[0] == 0x04) return 1;
+		if (!packet_started) {
+			while((packet[0] = gdb_if_getchar()) != '$')
+				if(packet[0] == 0x04) return 1;
+		}
+		packet_started = false;
 
 		i = 0; csum = 0;
 		/* Capture packet data into buffer */
-		while((c = gdb_if_getchar()) != '#') {
+		while(1) {
+#if defined(LIBFTDI)
+			i += gdb_getpacket_run(packet + i, size - i, &csum);
+#endif
+			if((c = gdb_if_getchar()) == '#')
+				break;
 
 			if(i == size) break; /* Oh shit */
 
@@ -68,10 +121,17 @@ int gdb_getpacket(char *packet, int size)
 		/* return packet if checksum matches */
 		if(csum == strtol(recv_csum, NULL, 16)) break;
 
+		/* Without acks GDB won't resend, use what we've got */
+		if(noackmode) {
+			DEBUG("%s: checksum mismatch\n", __func__);
+			break;
+		}
+
 		/* get here if checksum fails */
 		gdb_if_putchar('-', 1); /* send nack */
 	}
-	gdb_if_putchar('+', 1); /* send ack */
+	if(!noackmode)
+		gdb_if_putchar('+', 1); /* send ack */
 	packet[i] = 0;
 
 #ifdef DEBUG_GDBPACKET
@@ -88,45 +148,58 @@ int gdb_getpacket(char *packet, int size)
 	return i;
 }
 
-void gdb_putpacket(const char *packet, int size)
+static void gdb_putframe(char start, const char *packet, int size)
 {
 	int i;
 	unsigned char csum;
 	unsigned char c;
 	char xmit_csum[3];
-	int tries = 0;
 
-	do {
 #ifdef DEBUG_GDBPACKET
-		DEBUG("%s : ", __func__);
+	DEBUG("%s : %c", __func__, start);
 #endif
-		csum = 0;
-		gdb_if_putchar('$', 0);
-		for(i = 0; i < size; i++) {
-			c = packet[i];
+	csum = 0;
+	gdb_if_putchar(start, 0);
+	for(i = 0; i < size; i++) {
+		c = packet[i];
 #ifdef DEBUG_GDBPACKET
-			if ((c >= 32) && (c < 127))
-				DEBUG("%c", c);
-			else
-				DEBUG("\\x%02X", c);
+		if ((c >= 32) && (c < 127))
+			DEBUG("%c", c);
+		else
+			DEBUG("\\x%02X", c);
 #endif
-			if((c == '$') || (c == '#') || (c == '}')) {
-				gdb_if_putchar('}', 0);
-				gdb_if_putchar(c ^ 0x20, 0);
-				csum += '}' + (c ^ 0x20);
-			} else {
-				gdb_if_putchar(c, 0);
-				csum += c;
-			}
+		/* '*' would be taken as run-length encoding */
+		if((c == '$') || (c == '#') || (c == '}') || (c == '*')) {
+			gdb_if_putchar('}', 0);
+			gdb_if_putchar(c ^ 0x20, 0);
+			csum += '}' + (c ^ 0x20);
+		} else {
+			gdb_if_putchar(c, 0);
+			csum += c;
 		}
-		gdb_if_putchar('#', 0);
-		sprintf(xmit_csum, "%02X", csum);
-		gdb_if_putchar(xmit_csum[0], 0);
-		gdb_if_putchar(xmit_csum[1], 1);
+	}
+	gdb_if_putchar('#', 0);
+	sprintf(xmit_csum, "%02X", csum);
+	gdb_if_putchar(xmit_csum[0], 0);
+	gdb_if_putchar(xmit_csum[1], 1);
 #ifdef DEBUG_GDBPACKET
-		DEBUG("\n");
+	DEBUG("\n");
 #endif
-	} while((gdb_if_getchar_to(2000) != '+') && (tries++ < 3));
+}
+
+void gdb_putpacket(const char *packet, int size)
+{
+	int tries = 0;
+
+	do {
+		gdb_putframe('$', packet, size);
+	} while(!noackmode && (gdb_if_getchar_to(2000) != '+') && (tries++ < 3));
+}
+
+/* Asynchronous notification, these are never acknowledged */
+void gdb_putnotification(const char *packet, int size)
+{
+	gdb_putframe('%', packet, size);
 }
 
 void gdb_putpacket_f(const char *fmt, ...)
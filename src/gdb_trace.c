@@ -0,0 +1,558 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements GDB tracepoints.  Tracepoints are hardware
+ * breakpoints, on a hit the requested registers and memory are copied
+ * into the trace buffer and the target is resumed without involving
+ * GDB.  Frames are read back with tfind once tracing has stopped.
+ *
+ * Only register and memory collection is supported, while-stepping
+ * actions and collect expressions are ignored.  The buffer isn't
+ * circular, tracing stops when it is full as GDB does by default.
+ */
+
+#include "general.h"
+#include "target.h"
+#include "hex_utils.h"
+#include "gdb_packet.h"
+#include "gdb_agent.h"
+#include "gdb_trace.h"
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 2048
+#endif
+
+/* GDB register number of the PC in the ARM target descriptions */
+#define REGNUM_PC	15
+/* Breakpoint length used for tracepoints, the Thumb BKPT size */
+#define TRACE_BP_LEN	2
+
+struct trace_mem {
+	struct trace_mem *next;
+	int basereg;	/* -1 for an absolute address */
+	uint32_t offset;
+	uint32_t len;
+};
+
+struct tracepoint {
+	struct tracepoint *next;
+	uint32_t num;
+	target_addr addr;
+	bool enabled;
+	uint32_t pass;	/* Stop after this many hits, 0 for no limit */
+	uint32_t hits;
+	bool collect_regs;
+	struct trace_mem *mem;
+	size_t cond_len;
+	uint8_t *cond;
+};
+
+/* Each frame is a header followed by blocks, an 'R' block holds the
+ * whole register file, an 'M' block a 32-bit address, a 16-bit length
+ * and the data. */
+struct trace_frame {
+	uint16_t tpnum;
+	uint16_t size;	/* Of the blocks following the header */
+	uint32_t pc;
+};
+
+#if defined(LIBFTDI)
+static uint8_t *trace_buf;
+#else
+static uint8_t trace_buf[TRACE_BUFFER_SIZE];
+#endif
+static size_t trace_used;
+static uint32_t trace_frames;
+
+static struct tracepoint *tracepoints;
+static bool trace_running;
+static bool trace_ended;	/* Collection ended by a hit */
+static const char *trace_stop_reason = "tnotrun";
+static uint32_t trace_stop_tp;
+/* Size of the 'R' blocks, fixed while tracing */
+static size_t trace_regs_size;
+/* Offset of the frame GDB looks at, -1 for none */
+static long trace_cur = -1;
+static uint32_t trace_cur_num;
+
+static void trace_clear(void)
+{
+	while (tracepoints) {
+		struct tracepoint *next = tracepoints->next;
+		while (tracepoints->mem) {
+			struct trace_mem *m = tracepoints->mem->next;
+			free(tracepoints->mem);
+			tracepoints->mem = m;
+		}
+		free(tracepoints->cond);
+		free(tracepoints);
+		tracepoints = next;
+	}
+	trace_used = 0;
+	trace_frames = 0;
+	trace_cur = -1;
+	trace_stop_reason = "tnotrun";
+	trace_stop_tp = 0;
+}
+
+static struct tracepoint *trace_find(uint32_t num, target_addr addr)
+{
+	for (struct tracepoint *tp = tracepoints; tp; tp = tp->next)
+		if ((tp->num == num) && (tp->addr == addr))
+			return tp;
+	return NULL;
+}
+
+/* Removes the breakpoints of the tracepoints before end, NULL for all */
+static void trace_uninstall(target *t, struct tracepoint *end)
+{
+	for (struct tracepoint *tp = tracepoints; tp != end; tp = tp->next)
+		if (tp->enabled)
+			target_breakwatch_clear(t, TARGET_BREAK_HARD,
+			                        tp->addr, TRACE_BP_LEN);
+}
+
+static bool trace_install(target *t)
+{
+	for (struct tracepoint *tp = tracepoints; tp; tp = tp->next) {
+		tp->hits = 0;
+		if (tp->enabled &&
+		    target_breakwatch_set(t, TARGET_BREAK_HARD,
+		                          tp->addr, TRACE_BP_LEN)) {
+			trace_uninstall(t, tp);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* 'QTDP:n:addr:E:step:pass[:Xlen,cond]' defines a tracepoint,
+ * 'QTDP:-n:addr:actions' adds actions to it. */
+static bool trace_define(const char *p)
+{
+	char *end;
+	bool actions = *p == '-';
+	uint32_t num = strtoul(p + actions, &end, 16);
+	target_addr addr = strtoul(end + 1, &end, 16);
+	struct tracepoint *tp;
+
+	if (*end != ':')
+		return false;
+	p = end + 1;
+
+	if (!actions) {
+		if (!(tp = calloc(1, sizeof(*tp))))
+			return false;
+		tp->num = num;
+		tp->addr = addr;
+		tp->enabled = *p == 'E';
+		if (strtoul(p + 2, &end, 16))
+			DEBUG("Tracepoint %" PRIx32 ": while-stepping ignored\n", num);
+		tp->pass = strtoul(end + 1, &end, 16);
+		if (!strncmp(end, ":X", 2)) {
+			tp->cond_len = strtoul(end + 2, &end, 16);
+			tp->cond = malloc(tp->cond_len);
+			if (!tp->cond || (*end != ',')) {
+				free(tp->cond);
+				free(tp);
+				return false;
+			}
+			unhexify(tp->cond, end + 1, tp->cond_len);
+		}
+		tp->next = tracepoints;
+		tracepoints = tp;
+		return true;
+	}
+
+	if (!(tp = trace_find(num, addr)))
+		return false;
+	if (*p == 'S') {
+		DEBUG("Tracepoint %" PRIx32 ": while-stepping ignored\n", num);
+		return true;
+	}
+	while (*p && (*p != '-')) {
+		switch (*p) {
+		case 'R':
+			tp->collect_regs = true;
+			strtoul(p + 1, &end, 16);
+			p = end;
+			break;
+		case 'M': {
+			struct trace_mem *m = malloc(sizeof(*m));
+			if (!m)
+				return false;
+			m->basereg = strtol(p + 1, &end, 16);
+			m->offset = strtoul(end + 1, &end, 16);
+			m->len = strtoul(end + 1, &end, 16);
+			m->next = tp->mem;
+			tp->mem = m;
+			p = end;
+			break;
+			}
+		case 'X': {
+			/* Collect expressions need trace bytecodes */
+			size_t len = strtoul(p + 1, &end, 16);
+			DEBUG("Tracepoint %" PRIx32 ": expression ignored\n", num);
+			p = end + 1 + len * 2;
+			break;
+			}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+static void trace_status(void)
+{
+	char status[32];
+
+	if (trace_running)
+		strcpy(status, "T1");
+	else
+		/* Only tpasscount names a tracepoint, the others take 0 */
+		snprintf(status, sizeof(status), "T0;%s:%" PRIx32,
+		         trace_stop_reason, trace_stop_tp);
+
+	gdb_putpacket_f("%s;tframes:%" PRIx32 ";tcreated:%" PRIx32
+	                ";tfree:%x;tsize:%x;circular:0;disconn:0", status,
+	                trace_frames, trace_frames,
+	                (unsigned)(TRACE_BUFFER_SIZE - trace_used),
+	                (unsigned)TRACE_BUFFER_SIZE);
+}
+
+/* Walks the frames, calling match() on each after the current one */
+static void trace_select(bool (*match)(const struct trace_frame *, uint32_t,
+                                       uint32_t, uint32_t),
+                         uint32_t a, uint32_t b)
+{
+	size_t offset = 0;
+	uint32_t num = 0;
+
+	while (offset < trace_used) {
+		struct trace_frame f;
+		memcpy(&f, trace_buf + offset, sizeof(f));
+		if (((trace_cur < 0) || (num > trace_cur_num)) &&
+		    match(&f, num, a, b)) {
+			trace_cur = offset;
+			trace_cur_num = num;
+			gdb_putpacket_f("F%" PRIx32 "T%x", num, f.tpnum);
+			return;
+		}
+		offset += sizeof(f) + f.size;
+		num++;
+	}
+	gdb_putpacketz("F-1");
+}
+
+static bool match_num(const struct trace_frame *f, uint32_t num,
+                      uint32_t a, uint32_t b)
+{
+	(void)f; (void)b;
+	return num == a;
+}
+
+static bool match_pc(const struct trace_frame *f, uint32_t num,
+                     uint32_t a, uint32_t b)
+{
+	(void)num; (void)b;
+	return f->pc == a;
+}
+
+static bool match_tdp(const struct trace_frame *f, uint32_t num,
+                      uint32_t a, uint32_t b)
+{
+	(void)num; (void)b;
+	return f->tpnum == a;
+}
+
+static bool match_range(const struct trace_frame *f, uint32_t num,
+                        uint32_t a, uint32_t b)
+{
+	(void)num;
+	return (f->pc >= a) && (f->pc <= b);
+}
+
+static bool match_outside(const struct trace_frame *f, uint32_t num,
+                          uint32_t a, uint32_t b)
+{
+	return !match_range(f, num, a, b);
+}
+
+bool gdb_trace_packet(target *t, const char *packet)
+{
+	uint32_t a, b;
+
+	if (!strcmp(packet, "QTinit")) {
+		if (trace_running && t)
+			trace_uninstall(t, NULL);
+		trace_running = false;
+		trace_clear();
+		gdb_putpacketz("OK");
+
+	} else if (!strncmp(packet, "QTDP:", 5)) {
+		gdb_putpacketz(trace_define(packet + 5) ? "OK" : "E01");
+
+	} else if (!strcmp(packet, "QTStart")) {
+#if defined(LIBFTDI)
+		if (!trace_buf)
+			trace_buf = malloc(TRACE_BUFFER_SIZE);
+		if (!trace_buf) {
+			gdb_putpacketz("E01");
+			return true;
+		}
+#endif
+		if (!t || !trace_install(t)) {
+			gdb_putpacketz("E01");
+			return true;
+		}
+		trace_used = 0;
+		trace_frames = 0;
+		trace_cur = -1;
+		trace_stop_tp = 0;
+		trace_regs_size = target_regs_size(t);
+		trace_running = true;
+		trace_ended = false;
+		gdb_putpacketz("OK");
+
+	} else if (!strcmp(packet, "QTStop")) {
+		if (trace_running && t)
+			trace_uninstall(t, NULL);
+		if (trace_running)
+			trace_stop_reason = "tstop";
+		trace_running = false;
+		gdb_putpacketz("OK");
+
+	} else if (!strcmp(packet, "qTStatus")) {
+		trace_status();
+
+	} else if (!strncmp(packet, "QTFrame:", 8)) {
+		packet += 8;
+		if (sscanf(packet, "pc:%" SCNx32, &a) == 1) {
+			trace_select(match_pc, a, 0);
+		} else if (sscanf(packet, "tdp:%" SCNx32, &a) == 1) {
+			trace_select(match_tdp, a, 0);
+		} else if (sscanf(packet, "range:%" SCNx32 ":%" SCNx32, &a, &b) == 2) {
+			trace_select(match_range, a, b);
+		} else if (sscanf(packet, "outside:%" SCNx32 ":%" SCNx32, &a, &b) == 2) {
+			trace_select(match_outside, a, b);
+		} else if (*packet == '-') {
+			trace_cur = -1;
+			gdb_putpacketz("OK");
+		} else {
+			/* Frames are looked up from the start */
+			trace_cur = -1;
+			trace_select(match_num, strtoul(packet, NULL, 16), 0);
+		}
+
+	} else if (!strcmp(packet, "qTfP") || !strcmp(packet, "qTsP") ||
+	           !strcmp(packet, "qTfV") || !strcmp(packet, "qTsV")) {
+		/* Nothing to upload, GDB made all the tracepoints */
+		gdb_putpacketz("l");
+
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static void trace_write(size_t *offset, const void *data, size_t len)
+{
+	memcpy(trace_buf + *offset, data, len);
+	*offset += len;
+}
+
+bool gdb_trace_hit(target *t, target_addr pc)
+{
+	struct tracepoint *tp;
+
+	if (!trace_running)
+		return false;
+	for (tp = tracepoints; tp; tp = tp->next)
+		if (tp->enabled && (tp->addr == pc))
+			break;
+	if (!tp)
+		return false;
+
+	int64_t result;
+	if (tp->cond && gdb_agent_eval(t, tp->cond, tp->cond_len, &result) &&
+	    !result)
+		return true;
+
+	/* Size the frame first, it must fit in one piece */
+	size_t size = 0;
+	if (tp->collect_regs)
+		size += 1 + trace_regs_size;
+	for (struct trace_mem *m = tp->mem; m; m = m->next)
+		size += 1 + 4 + 2 + m->len;
+
+	if ((size > UINT16_MAX) ||
+	    (trace_used + sizeof(struct trace_frame) + size > TRACE_BUFFER_SIZE)) {
+		trace_stop_reason = "tfull";
+		trace_ended = true;
+		return true;
+	}
+
+	struct trace_frame f = { .tpnum = tp->num, .size = size, .pc = pc };
+	size_t offset = trace_used;
+	trace_write(&offset, &f, sizeof(f));
+
+	if (tp->collect_regs) {
+		/* The drivers store words, the block isn't word aligned */
+		uint32_t regs[(trace_regs_size + 3) / 4];
+		target_regs_read(t, regs);
+		trace_buf[offset++] = 'R';
+		trace_write(&offset, regs, trace_regs_size);
+	}
+	for (struct trace_mem *m = tp->mem; m; m = m->next) {
+		uint32_t addr = m->offset;
+		uint16_t mlen = m->len;
+		if (m->basereg >= 0) {
+			uint32_t base = 0;
+			target_reg_read(t, m->basereg, &base, sizeof(base));
+			addr += base;
+		}
+		trace_buf[offset++] = 'M';
+		trace_write(&offset, &addr, sizeof(addr));
+		trace_write(&offset, &mlen, sizeof(mlen));
+		/* Unreadable memory is recorded as zeros */
+		if (target_mem_read(t, trace_buf + offset, addr, mlen))
+			memset(trace_buf + offset, 0, mlen);
+		offset += mlen;
+	}
+	trace_used = offset;
+	trace_frames++;
+
+	if (tp->pass && (++tp->hits >= tp->pass)) {
+		trace_stop_reason = "tpasscount";
+		trace_stop_tp = tp->num;
+		trace_ended = true;
+	}
+	return true;
+}
+
+void gdb_trace_update(target *t)
+{
+	if (!trace_running || !trace_ended)
+		return;
+	trace_uninstall(t, NULL);
+	trace_running = false;
+}
+
+void gdb_trace_detach(void)
+{
+	if (trace_running) {
+		trace_stop_reason = "tdisconnected";
+		trace_stop_tp = 0;
+	}
+	trace_running = false;
+}
+
+bool gdb_trace_frame_selected(void)
+{
+	return trace_cur >= 0;
+}
+
+/* Find a block of the selected frame */
+static const uint8_t *trace_block(char type, target_addr addr, size_t len)
+{
+	struct trace_frame f;
+	memcpy(&f, trace_buf + trace_cur, sizeof(f));
+	const uint8_t *p = trace_buf + trace_cur + sizeof(f);
+	const uint8_t *end = p + f.size;
+
+	while (p < end) {
+		if (*p == 'R') {
+			if (type == 'R')
+				return p + 1;
+			p += 1 + trace_regs_size;
+			continue;
+		}
+		uint32_t maddr;
+		uint16_t mlen;
+		memcpy(&maddr, p + 1, sizeof(maddr));
+		memcpy(&mlen, p + 5, sizeof(mlen));
+		if ((type == 'M') && (addr >= maddr) &&
+		    (addr + len <= maddr + mlen))
+			return p + 7 + (addr - maddr);
+		p += 7 + mlen;
+	}
+	return NULL;
+}
+
+/* Registers that weren't collected are reported unavailable, apart
+ * from the PC which is known from the tracepoint. */
+void gdb_trace_regs_read(target *t, char *hex)
+{
+	size_t size = target_regs_size(t);
+	const uint8_t *regs = NULL;
+	struct trace_frame f;
+
+	memcpy(&f, trace_buf + trace_cur, sizeof(f));
+	regs = trace_block('R', 0, 0);
+	if (regs && (size == trace_regs_size)) {
+		hexify(hex, regs, size);
+		return;
+	}
+	memset(hex, 'x', size * 2);
+	hex[size * 2] = 0;
+	hexify(hex + REGNUM_PC * 8, &f.pc, sizeof(f.pc));
+	hex[REGNUM_PC * 8 + 8] = 'x';
+}
+
+/* Find a register in the 'g' packet layout from the bitsizes in the
+ * target description. */
+static bool tdesc_reg_offset(const char *tdesc, int reg, size_t *offset,
+                             size_t *size)
+{
+	const char *p = tdesc;
+	*offset = 0;
+	for (int i = 0; (p = strstr(p, "<reg ")); i++) {
+		const char *bits = strstr(p, "bitsize=\"");
+		if (!bits)
+			return false;
+		*size = strtoul(bits + 9, NULL, 10) / 8;
+		if (i == reg)
+			return true;
+		*offset += *size;
+		p = bits;
+	}
+	return false;
+}
+
+bool gdb_trace_reg_read(target *t, int reg, char *hex)
+{
+	size_t offset, size;
+
+	if (!tdesc_reg_offset(target_tdesc(t), reg, &offset, &size) ||
+	    (offset + size > target_regs_size(t)))
+		return false;
+	char regs[target_regs_size(t) * 2 + 1];
+	gdb_trace_regs_read(t, regs);
+	memcpy(hex, regs + offset * 2, size * 2);
+	hex[size * 2] = 0;
+	return true;
+}
+
+int gdb_trace_mem_read(void *dest, target_addr addr, size_t len)
+{
+	const uint8_t *data = trace_block('M', addr, len);
+	if (!data)
+		return -1;
+	memcpy(dest, data, len);
+	return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __GDB_TRACE_H
+#define __GDB_TRACE_H
+
+#include "target.h"
+
+/* Handles QT and qT packets, returns false for anything else */
+bool gdb_trace_packet(target *t, const char *packet);
+
+/* Called when the target stops on a breakpoint.  Returns true if pc
+ * is an active tracepoint, the breakpoint must then be stepped over
+ * unless GDB has one of its own there. */
+bool gdb_trace_hit(target *t, target_addr pc);
+/* Removes the tracepoints once collection has ended, call after the
+ * target has been stepped off a tracepoint. */
+void gdb_trace_update(target *t);
+/* Stops collection when GDB detaches, the target's breakpoints are
+ * gone with it. */
+void gdb_trace_detach(void);
+
+/* While GDB inspects a trace frame, register and memory reads are
+ * served from it. */
+bool gdb_trace_frame_selected(void);
+void gdb_trace_regs_read(target *t, char *hex);
+bool gdb_trace_reg_read(target *t, int reg, char *hex);
+int gdb_trace_mem_read(void *dest, target_addr addr, size_t len);
+
+#endif
@@ -35,5 +35,11 @@ int command_process(target *t, char *cmd);
  */
 bool parse_enable_or_disable(const char *s, bool *out);
 
+/*
+ * Parses a frequency in Hz, optionally suffixed with 'k' or 'M'.
+ * Returns false and leaves freq untouched on anything else.
+ */
+bool parse_frequency(const char *s, uint32_t *freq);
+
 #endif
 
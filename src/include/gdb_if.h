@@ -31,5 +31,11 @@ unsigned char gdb_if_getchar(void);
 unsigned char gdb_if_getchar_to(int timeout);
 void gdb_if_putchar(unsigned char c, int flush);
 
+#if defined(LIBFTDI)
+/* Already received bytes, for bulk copying by the packet layer */
+int gdb_if_peek(const unsigned char **buf);
+void gdb_if_consume(int len);
+#endif
+
 #endif
 
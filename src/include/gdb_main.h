@@ -23,5 +23,18 @@
 
 void gdb_main(void);
 
+/* Halt polling while the target runs, intervals in ms */
+extern uint32_t halt_poll_min;
+extern uint32_t halt_poll_max;
+
+struct halt_poll_stats {
+	uint32_t runs;		/* Times the target was resumed */
+	uint32_t polls;		/* Total calls to target_halt_poll() */
+	uint32_t run_time;	/* Total ms spent waiting for a halt */
+	uint32_t last_polls;	/* Polls during the last run */
+	uint32_t last_run_time;	/* ms spent in the last run */
+};
+extern struct halt_poll_stats halt_poll_stats;
+
 #endif
 
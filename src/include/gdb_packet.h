@@ -27,6 +27,11 @@ int gdb_getpacket(char *packet, int size);
 void gdb_putpacket(const char *packet, int size);
 #define gdb_putpacketz(packet) gdb_putpacket((packet), strlen(packet))
 void gdb_putpacket_f(const char *packet, ...);
+void gdb_set_noackmode(bool enable);
+void gdb_putnotification(const char *packet, int size);
+/* Wait up to timeout ms for input from GDB.  If a packet starts,
+ * gdb_getpacket() carries on from there. */
+unsigned char gdb_packet_wait(int timeout);
 
 void gdb_out(const char *buf);
 void gdb_voutf(const char *fmt, va_list);
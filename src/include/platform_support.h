@@ -42,6 +42,10 @@ bool platform_srst_get_val(void);
 bool platform_target_get_power(void);
 void platform_target_set_power(bool power);
 void platform_request_boot(void);
+#if defined(PLATFORM_HAS_FREQUENCY)
+void platform_max_frequency_set(uint32_t freq);
+uint32_t platform_max_frequency_get(void);
+#endif
 
 #endif
 
@@ -33,5 +33,18 @@ bool swdptap_seq_in_parity(uint32_t *data, int ticks);
 void swdptap_seq_out(uint32_t MS, int ticks);
 void swdptap_seq_out_parity(uint32_t MS, int ticks);
 
+#if defined(PLATFORM_HAS_SWD_QUEUE)
+/* Queued input, for platforms where each read is a round trip to the
+ * hardware.  The cycles are clocked in order with the surrounding output,
+ * but the captured data is only available after swdptap_queue_run().
+ * swdptap_seq_in_queued() returns a token for swdptap_queue_result(),
+ * which decodes up to 32 data bits and the parity of all ticks.
+ */
+bool swdptap_queue_room(int ticks);
+int swdptap_seq_in_queued(int ticks);
+void swdptap_queue_run(void);
+uint32_t swdptap_queue_result(int token, bool *parity);
+#endif
+
 #endif
 
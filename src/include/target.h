@@ -36,6 +36,10 @@ typedef uint32_t target_addr;
 struct target_controller;
 
 int adiv5_swdp_scan(void);
+#if defined(PLATFORM_HAS_FREQUENCY)
+extern bool swdp_calibrate;
+extern uint32_t swdp_calibrated_frequency;
+#endif
 int jtag_scan(const uint8_t *lrlens);
 
 bool target_foreach(void (*cb)(int i, target *t, void *context), void *context);
@@ -62,6 +66,8 @@ size_t target_regs_size(target *t);
 const char *target_tdesc(target *t);
 void target_regs_read(target *t, void *data);
 void target_regs_write(target *t, const void *data);
+ssize_t target_reg_read(target *t, int reg, void *data, size_t max);
+ssize_t target_reg_write(target *t, int reg, const void *data, size_t size);
 
 /* Halt/resume functions */
 enum target_halt_reason {
@@ -89,6 +95,7 @@ enum target_breakwatch {
 };
 int target_breakwatch_set(target *t, enum target_breakwatch, target_addr, size_t);
 int target_breakwatch_clear(target *t, enum target_breakwatch, target_addr, size_t);
+void target_breakwatch_lift(target *t, target_addr addr, bool lift);
 
 /* Command interpreter */
 void target_command_help(target *t);
@@ -160,8 +167,13 @@ struct target_controller {
 	int (*isatty)(struct target_controller *, int fd);
 	int (*system)(struct target_controller *,
 	              target_addr cmd, size_t cmd_len);
+	/* Console output already read from the target, returns -1 if
+	 * the controller leaves it to write() */
+	int (*console_write)(struct target_controller *,
+	                     const void *buf, unsigned int count);
 	enum target_errno errno_;
 	bool interrupted;
+	target *t;	/* Attached target, set by target_attach() */
 };
 
 #endif
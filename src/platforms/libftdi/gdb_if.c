@@ -39,6 +39,7 @@
 
 #include "general.h"
 #include "gdb_if.h"
+#include "gdb_packet.h"
 
 static int gdb_if_serv, gdb_if_conn;
 
@@ -69,25 +70,44 @@ int gdb_if_init(void)
 }
 
 
+/* Data received from GDB but not yet consumed. A whole packet normally
+ * arrives in one segment, so one recv() per packet is enough. */
+static unsigned char recv_buf[4096];
+static int recv_head, recv_tail;
+
+int gdb_if_peek(const unsigned char **buf)
+{
+	*buf = recv_buf + recv_head;
+	return recv_tail - recv_head;
+}
+
+void gdb_if_consume(int len)
+{
+	recv_head += len;
+}
+
 unsigned char gdb_if_getchar(void)
 {
-	unsigned char ret;
-	int i = 0;
+	int i;
 
-	while(i <= 0) {
+	while(recv_head == recv_tail) {
 		if(gdb_if_conn <= 0) {
 			gdb_if_conn = accept(gdb_if_serv, NULL, NULL);
 			DEBUG("Got connection\n");
 		}
-		i = recv(gdb_if_conn, (void*)&ret, 1, 0);
+		recv_head = recv_tail = 0;
+		i = recv(gdb_if_conn, (void*)recv_buf, sizeof(recv_buf), 0);
 		if(i <= 0) {
 			gdb_if_conn = -1;
 			DEBUG("Dropped broken connection\n");
+			/* The next GDB starts out acknowledging packets */
+			gdb_set_noackmode(false);
 			/* Return '+' in case we were waiting for an ACK */
 			return '+';
 		}
+		recv_tail = i;
 	}
-	return ret;
+	return recv_buf[recv_head++];
 }
 
 unsigned char gdb_if_getchar_to(int timeout)
@@ -99,6 +119,9 @@ unsigned char gdb_if_getchar_to(int timeout)
 	struct timeval tv;
 #endif
 
+	if(recv_head != recv_tail)
+		return recv_buf[recv_head++];
+
 	if(gdb_if_conn == -1) return -1;
 
 	tv.tv_sec = timeout / 1000;
@@ -0,0 +1,398 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements semihosting file I/O on the host running the
+ * probe, as an alternative to GDB's File-I/O.  Files live in a chosen
+ * directory and data moves in large blocks of target memory, rather
+ * than a GDB round trip and 'm'/'M' packets per call.
+ */
+
+#include "general.h"
+#include "target.h"
+#include "gdb_hostio.h"
+#include "hostio_fs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define HOSTIO_FS_PATH_MAX	1024
+/* Host fds are offset so they can't be mistaken for GDB's */
+#define HOSTIO_FS_FD_BASE	0x1000
+/* Size of the blocks moved to and from target memory */
+#define HOSTIO_FS_CHUNK		0x10000
+#define HOSTIO_FS_MAX_FILES	32
+
+static char *fs_dir;
+static uint8_t fs_buf[HOSTIO_FS_CHUNK];
+/* Host fds of the files open, -1 for a free slot */
+static int fs_files[HOSTIO_FS_MAX_FILES] = {
+	[0 ... HOSTIO_FS_MAX_FILES - 1] = -1
+};
+
+bool hostio_fs_set_dir(const char *dir)
+{
+	free(fs_dir);
+	fs_dir = NULL;
+	if (dir && !(fs_dir = strdup(dir)))
+		return false;
+	return true;
+}
+
+const char *hostio_fs_dir(void)
+{
+	return fs_dir;
+}
+
+void hostio_fs_close_all(void)
+{
+	for (unsigned i = 0; i < HOSTIO_FS_MAX_FILES; i++) {
+		if (fs_files[i] >= 0)
+			close(fs_files[i]);
+		fs_files[i] = -1;
+	}
+}
+
+static int *fs_file_slot(int fd)
+{
+	for (unsigned i = 0; i < HOSTIO_FS_MAX_FILES; i++)
+		if (fs_files[i] == fd)
+			return &fs_files[i];
+	return NULL;
+}
+
+/* Only files the target opened can be used, not any fd of the probe */
+static int fs_host_fd(struct target_controller *tc, int fd)
+{
+	fd -= HOSTIO_FS_FD_BASE;
+	if ((fd < 0) || !fs_file_slot(fd)) {
+		tc->errno_ = TARGET_EBADF;
+		return -1;
+	}
+	return fd;
+}
+
+/* Names are kept under fs_dir, no ".." components */
+static bool fs_name_valid(const char *name)
+{
+	const char *p = name;
+
+	while (*p) {
+		size_t len = strcspn(p, "/\\");
+		if ((len == 2) && (p[0] == '.') && (p[1] == '.'))
+			return false;
+		p += len;
+		if (*p)
+			p++;
+	}
+	return true;
+}
+
+/* The target's console fds and files opened by GDB stay with GDB */
+static bool fs_local(int fd)
+{
+	return fd >= HOSTIO_FS_FD_BASE;
+}
+
+static int fs_error(struct target_controller *tc)
+{
+	switch (errno) {
+	case EPERM: tc->errno_ = TARGET_EPERM; break;
+	case ENOENT: tc->errno_ = TARGET_ENOENT; break;
+	case EINTR: tc->errno_ = TARGET_EINTR; break;
+	case EBADF: tc->errno_ = TARGET_EBADF; break;
+	case EACCES: tc->errno_ = TARGET_EACCES; break;
+	case EFAULT: tc->errno_ = TARGET_EFAULT; break;
+	case EBUSY: tc->errno_ = TARGET_EBUSY; break;
+	case EEXIST: tc->errno_ = TARGET_EEXIST; break;
+	case ENODEV: tc->errno_ = TARGET_ENODEV; break;
+	case ENOTDIR: tc->errno_ = TARGET_ENOTDIR; break;
+	case EISDIR: tc->errno_ = TARGET_EISDIR; break;
+	case EMFILE: tc->errno_ = TARGET_EMFILE; break;
+	case ENFILE: tc->errno_ = TARGET_ENFILE; break;
+	case EFBIG: tc->errno_ = TARGET_EFBIG; break;
+	case ENOSPC: tc->errno_ = TARGET_ENOSPC; break;
+	case ESPIPE: tc->errno_ = TARGET_ESPIPE; break;
+	case EROFS: tc->errno_ = TARGET_EROFS; break;
+	case ENAMETOOLONG: tc->errno_ = TARGET_ENAMETOOLONG; break;
+	default: tc->errno_ = TARGET_EINVAL; break;
+	}
+	return -1;
+}
+
+/* Reads a target path, path_len includes the terminator */
+static bool fs_path(struct target_controller *tc, char *buf,
+                    target_addr path, size_t path_len)
+{
+	char name[HOSTIO_FS_PATH_MAX];
+
+	if (!path_len || (path_len > sizeof(name))) {
+		tc->errno_ = TARGET_ENAMETOOLONG;
+		return false;
+	}
+	if (target_mem_read(tc->t, name, path, path_len)) {
+		tc->errno_ = TARGET_EFAULT;
+		return false;
+	}
+	name[path_len - 1] = 0;
+	if (!fs_name_valid(name)) {
+		tc->errno_ = TARGET_EACCES;
+		return false;
+	}
+	if (snprintf(buf, HOSTIO_FS_PATH_MAX, "%s/%s", fs_dir, name) >=
+	    HOSTIO_FS_PATH_MAX) {
+		tc->errno_ = TARGET_ENAMETOOLONG;
+		return false;
+	}
+	return true;
+}
+
+int hostio_fs_open(struct target_controller *tc,
+                   target_addr path, size_t path_len,
+                   enum target_open_flags flags, mode_t mode)
+{
+	char name[HOSTIO_FS_PATH_MAX];
+	int oflags = O_BINARY;
+
+	if (!fs_dir)
+		return hostio_open(tc, path, path_len, flags, mode);
+	if (!fs_path(tc, name, path, path_len))
+		return -1;
+
+	switch (flags & (TARGET_O_WRONLY | TARGET_O_RDWR)) {
+	case TARGET_O_WRONLY: oflags |= O_WRONLY; break;
+	case TARGET_O_RDWR: oflags |= O_RDWR; break;
+	default: oflags |= O_RDONLY; break;
+	}
+	if (flags & TARGET_O_APPEND)
+		oflags |= O_APPEND;
+	if (flags & TARGET_O_CREAT)
+		oflags |= O_CREAT;
+	if (flags & TARGET_O_TRUNC)
+		oflags |= O_TRUNC;
+
+	int *slot = fs_file_slot(-1);
+	if (!slot) {
+		tc->errno_ = TARGET_EMFILE;
+		return -1;
+	}
+	int fd = open(name, oflags, mode);
+	if (fd < 0)
+		return fs_error(tc);
+	*slot = fd;
+	DEBUG("hostio_fs: open %s = %d\n", name, fd);
+	return fd + HOSTIO_FS_FD_BASE;
+}
+
+int hostio_fs_close(struct target_controller *tc, int fd)
+{
+	if (!fs_local(fd))
+		return hostio_close(tc, fd);
+	if ((fd = fs_host_fd(tc, fd)) < 0)
+		return -1;
+	*fs_file_slot(fd) = -1;
+	if (close(fd))
+		return fs_error(tc);
+	return 0;
+}
+
+int hostio_fs_read(struct target_controller *tc,
+                   int fd, target_addr buf, unsigned int count)
+{
+	unsigned int done = 0;
+
+	if (!fs_local(fd))
+		return hostio_read(tc, fd, buf, count);
+	if ((fd = fs_host_fd(tc, fd)) < 0)
+		return -1;
+	while (done < count) {
+		ssize_t len = read(fd, fs_buf, MIN(count - done, sizeof(fs_buf)));
+		if (len < 0)
+			return done ? (int)done : fs_error(tc);
+		if (len == 0)
+			break;
+		if (target_mem_write(tc->t, buf + done, fs_buf, len)) {
+			tc->errno_ = TARGET_EFAULT;
+			return -1;
+		}
+		done += len;
+	}
+	return done;
+}
+
+int hostio_fs_write(struct target_controller *tc,
+                    int fd, target_addr buf, unsigned int count)
+{
+	unsigned int done = 0;
+
+	if (!fs_local(fd))
+		return hostio_write(tc, fd, buf, count);
+	if ((fd = fs_host_fd(tc, fd)) < 0)
+		return -1;
+	while (done < count) {
+		size_t len = MIN(count - done, sizeof(fs_buf));
+		if (target_mem_read(tc->t, fs_buf, buf + done, len)) {
+			tc->errno_ = TARGET_EFAULT;
+			return -1;
+		}
+		ssize_t ret = write(fd, fs_buf, len);
+		if (ret < 0)
+			return done ? (int)done : fs_error(tc);
+		done += ret;
+		if ((size_t)ret < len)
+			break;
+	}
+	return done;
+}
+
+long hostio_fs_lseek(struct target_controller *tc,
+                     int fd, long offset, enum target_seek_flag flag)
+{
+	static const int whence[] = {
+		[TARGET_SEEK_SET] = SEEK_SET,
+		[TARGET_SEEK_CUR] = SEEK_CUR,
+		[TARGET_SEEK_END] = SEEK_END,
+	};
+
+	if (!fs_local(fd))
+		return hostio_lseek(tc, fd, offset, flag);
+	if ((fd = fs_host_fd(tc, fd)) < 0)
+		return -1;
+	if (flag > TARGET_SEEK_END) {
+		tc->errno_ = TARGET_EINVAL;
+		return -1;
+	}
+	off_t ret = lseek(fd, offset, whence[flag]);
+	if (ret < 0)
+		return fs_error(tc);
+	return ret;
+}
+
+int hostio_fs_rename(struct target_controller *tc,
+                     target_addr oldpath, size_t old_len,
+                     target_addr newpath, size_t new_len)
+{
+	char oldname[HOSTIO_FS_PATH_MAX], newname[HOSTIO_FS_PATH_MAX];
+
+	if (!fs_dir)
+		return hostio_rename(tc, oldpath, old_len, newpath, new_len);
+	if (!fs_path(tc, oldname, oldpath, old_len) ||
+	    !fs_path(tc, newname, newpath, new_len))
+		return -1;
+	if (rename(oldname, newname))
+		return fs_error(tc);
+	return 0;
+}
+
+int hostio_fs_unlink(struct target_controller *tc,
+                     target_addr path, size_t path_len)
+{
+	char name[HOSTIO_FS_PATH_MAX];
+
+	if (!fs_dir)
+		return hostio_unlink(tc, path, path_len);
+	if (!fs_path(tc, name, path, path_len))
+		return -1;
+	if (unlink(name))
+		return fs_error(tc);
+	return 0;
+}
+
+static void fs_put32(uint8_t **p, uint32_t val)
+{
+	for (int i = 3; i >= 0; i--)
+		*(*p)++ = val >> (i * 8);
+}
+
+static void fs_put64(uint8_t **p, uint64_t val)
+{
+	fs_put32(p, val >> 32);
+	fs_put32(p, val);
+}
+
+/* Store st as GDB's struct stat, see "struct stat" in the GDB manual's
+ * File-I/O protocol.  All fields are big-endian. */
+static int fs_stat_write(struct target_controller *tc, target_addr buf,
+                         const struct stat *st)
+{
+	uint8_t fst[64], *p = fst;
+
+	fs_put32(&p, st->st_dev);
+	fs_put32(&p, st->st_ino);
+	fs_put32(&p, st->st_mode);
+	fs_put32(&p, st->st_nlink);
+	fs_put32(&p, st->st_uid);
+	fs_put32(&p, st->st_gid);
+	fs_put32(&p, st->st_rdev);
+	fs_put64(&p, st->st_size);
+#if defined(_WIN32)
+	fs_put64(&p, 0);
+	fs_put64(&p, 0);
+#else
+	fs_put64(&p, st->st_blksize);
+	fs_put64(&p, st->st_blocks);
+#endif
+	fs_put32(&p, st->st_atime);
+	fs_put32(&p, st->st_mtime);
+	fs_put32(&p, st->st_ctime);
+
+	if (target_mem_write(tc->t, buf, fst, sizeof(fst))) {
+		tc->errno_ = TARGET_EFAULT;
+		return -1;
+	}
+	return 0;
+}
+
+int hostio_fs_stat(struct target_controller *tc,
+                   target_addr path, size_t path_len, target_addr buf)
+{
+	char name[HOSTIO_FS_PATH_MAX];
+	struct stat st;
+
+	if (!fs_dir)
+		return hostio_stat(tc, path, path_len, buf);
+	if (!fs_path(tc, name, path, path_len))
+		return -1;
+	if (stat(name, &st))
+		return fs_error(tc);
+	return fs_stat_write(tc, buf, &st);
+}
+
+int hostio_fs_fstat(struct target_controller *tc, int fd, target_addr buf)
+{
+	struct stat st;
+
+	if (!fs_local(fd))
+		return hostio_fstat(tc, fd, buf);
+	if ((fd = fs_host_fd(tc, fd)) < 0)
+		return -1;
+	if (fstat(fd, &st))
+		return fs_error(tc);
+	return fs_stat_write(tc, buf, &st);
+}
+
+int hostio_fs_isatty(struct target_controller *tc, int fd)
+{
+	if (!fs_local(fd))
+		return hostio_isatty(tc, fd);
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __HOSTIO_FS_H
+#define __HOSTIO_FS_H
+
+#include "target.h"
+
+/* Serve semihosting files from dir, NULL hands them back to GDB */
+bool hostio_fs_set_dir(const char *dir);
+const char *hostio_fs_dir(void);
+/* Closes the files the target left open, on detach */
+void hostio_fs_close_all(void);
+
+/* Interface to host system calls, as in gdb_hostio.h.  The console
+ * and calls made while no directory is set go to GDB. */
+int hostio_fs_open(struct target_controller *,
+                   target_addr path, size_t path_len,
+                   enum target_open_flags flags, mode_t mode);
+int hostio_fs_close(struct target_controller *, int fd);
+int hostio_fs_read(struct target_controller *,
+                   int fd, target_addr buf, unsigned int count);
+int hostio_fs_write(struct target_controller *,
+                    int fd, target_addr buf, unsigned int count);
+long hostio_fs_lseek(struct target_controller *,
+                     int fd, long offset, enum target_seek_flag flag);
+int hostio_fs_rename(struct target_controller *,
+                     target_addr oldpath, size_t old_len,
+                     target_addr newpath, size_t new_len);
+int hostio_fs_unlink(struct target_controller *,
+                     target_addr path, size_t path_len);
+int hostio_fs_stat(struct target_controller *,
+                   target_addr path, size_t path_len, target_addr buf);
+int hostio_fs_fstat(struct target_controller *, int fd, target_addr buf);
+int hostio_fs_isatty(struct target_controller *, int fd);
+
+#endif
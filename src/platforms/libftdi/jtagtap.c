@@ -56,13 +56,14 @@ int jtagtap_init(void)
 			err, ftdi_get_error_string(ftdic));
 		return -1;;
 	}
-	uint8_t ftdi_init[9] = {TCK_DIVISOR, 0x00, 0x00, SET_BITS_LOW, 0,0,
+	uint8_t ftdi_init[6] = {SET_BITS_LOW, 0,0,
 				SET_BITS_HIGH, 0,0};
-	ftdi_init[4]= active_cable->dbus_data;
-	ftdi_init[5]= active_cable->dbus_ddr;
-	ftdi_init[7]= active_cable->cbus_data;
-	ftdi_init[8]= active_cable->cbus_ddr;
-	platform_buffer_write(ftdi_init, 9);
+	ftdi_init[1]= active_cable->dbus_data;
+	ftdi_init[2]= active_cable->dbus_ddr;
+	ftdi_init[4]= active_cable->cbus_data;
+	ftdi_init[5]= active_cable->cbus_ddr;
+	platform_clock_init(0);
+	platform_buffer_write(ftdi_init, 6);
 	platform_buffer_flush();
 
 	/* Go to JTAG mode for SWJ-DP */
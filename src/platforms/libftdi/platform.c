@@ -21,10 +21,13 @@
 #include "gdb_if.h"
 #include "version.h"
 #include "platform.h"
+#include "command.h"
+#include "hostio_fs.h"
 
 #include <assert.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 
 struct ftdi_context *ftdic;
 
@@ -34,6 +37,13 @@ static uint16_t bufptr = 0;
 
 cable_desc_t *active_cable;
 
+/* Requested TCK/SWCLK frequency in Hz, 0 keeps the interface default */
+static uint32_t max_frequency;
+/* Current MPSSE clock setting, divisor is -1 until MPSSE is enabled */
+static int mpsse_divisor = -1;
+static uint16_t mpsse_default_divisor;
+static uint32_t mpsse_base_clock;
+
 cable_desc_t cable_desc[] = {
 	{
 		/* Direct connection from FTDI to Jtag/Swd.*/
@@ -70,6 +80,9 @@ cable_desc_t cable_desc[] = {
  * For bitbanged SWD, set Bit 5 low and select SWD read with
  * Bit 6 low. Read Connector TMS as FTDI TDO.
  *
+ * For MPSSE SWD, select SWD with Bit 6 low, so connector TMS is
+ * written from FTDI TDI. Reads are done as for bitbanged SWD.
+ *
  * TDO is routed to Interface 0 RXD as SWO or with Uart
  * Connector pin 10 pulled to ground will connect Interface 0 RXD
  * to UART connector RXD
@@ -84,6 +97,10 @@ cable_desc_t cable_desc[] = {
 		.bitbang_tms_in_port_cmd = GET_BITS_LOW,
 		.bitbang_tms_in_pin = MPSSE_TDO, /* keep bit 5 low*/
 		.bitbang_swd_dbus_read_data = 0x02,
+		.mpsse_swd_write_data = 0x2A,
+		.mpsse_swd_write_ddr = 0x6B,
+		.mpsse_swd_read_data = 0x02,
+		.mpsse_swd_read_ddr = 0x63,
 		.name = "ftdiswd"
 	},
 	{
@@ -185,7 +202,7 @@ void platform_init(int argc, char **argv)
 	unsigned index = 0;
 	char *serial = NULL;
 	char * cablename =  "ftdi";
-	while((c = getopt(argc, argv, "c:s:")) != -1) {
+	while((c = getopt(argc, argv, "c:s:f:d:")) != -1) {
 		switch(c) {
 		case 'c':
 			cablename =  optarg;
@@ -193,6 +210,15 @@ void platform_init(int argc, char **argv)
 		case 's':
 			serial = optarg;
 			break;
+		case 'f':
+			if (!parse_frequency(optarg, &max_frequency)) {
+				fprintf(stderr, "Invalid frequency %s\n", optarg);
+				exit(-1);
+			}
+			break;
+		case 'd':
+			hostio_fs_set_dir(optarg);
+			break;
 		}
 	}
 
@@ -286,6 +312,64 @@ int platform_buffer_read(uint8_t *data, int size)
 	return size;
 }
 
+static bool ftdi_is_h_series(void)
+{
+	return (ftdic->type == TYPE_2232H) || (ftdic->type == TYPE_4232H) ||
+		(ftdic->type == TYPE_232H);
+}
+
+/* Program the MPSSE clock, called by jtagtap_init() and swdptap_init()
+ * once MPSSE mode is enabled.  The clock is base / (2 * (1 + divisor)),
+ * the base is 60 MHz on H-series chips with divide-by-5 disabled and
+ * 12 MHz otherwise.  Without a requested frequency, the interface default
+ * divisor is used on the 12 MHz base.
+ */
+void platform_clock_init(uint16_t default_divisor)
+{
+	uint8_t cmd[4];
+	int index = 0;
+	uint32_t base = 12000000;
+	uint32_t divisor = default_divisor;
+
+	if (max_frequency && ftdi_is_h_series()) {
+		cmd[index++] = DIS_DIV_5;
+		base = 60000000;
+	} else if (ftdi_is_h_series()) {
+		cmd[index++] = EN_DIV_5;
+	}
+	if (max_frequency) {
+		divisor = (base / 2 + max_frequency - 1) / max_frequency;
+		if (divisor)
+			divisor--;
+		if (divisor > 0xffff)
+			divisor = 0xffff;
+	}
+	cmd[index++] = TCK_DIVISOR;
+	cmd[index++] = divisor & 0xff;
+	cmd[index++] = divisor >> 8;
+	platform_buffer_write(cmd, index);
+
+	mpsse_divisor = divisor;
+	mpsse_default_divisor = default_divisor;
+	mpsse_base_clock = base;
+}
+
+void platform_max_frequency_set(uint32_t freq)
+{
+	max_frequency = freq;
+	if (mpsse_divisor < 0)
+		return;
+	platform_clock_init(mpsse_default_divisor);
+	platform_buffer_flush();
+}
+
+uint32_t platform_max_frequency_get(void)
+{
+	if (mpsse_divisor < 0)
+		return max_frequency;
+	return mpsse_base_clock / (2 * (mpsse_divisor + 1));
+}
+
 #if defined(_WIN32) && !defined(__MINGW32__)
 #warning "This vasprintf() is dubious!"
 int vasprintf(char **strp, const char *fmt, va_list ap)
@@ -312,8 +396,15 @@ void platform_delay(uint32_t ms)
 
 uint32_t platform_time_ms(void)
 {
+#if defined(CLOCK_MONOTONIC)
+	/* Unaffected by changes to the wall clock, for timing the target */
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+#else
 	struct timeval tv;
 	gettimeofday(&tv, NULL);
 	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+#endif
 }
 
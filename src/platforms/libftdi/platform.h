@@ -37,6 +37,17 @@
 #define FT2232_PID	0x6010
 
 #define PLATFORM_HAS_DEBUG
+/* Every SWD read is a USB round trip, batch ADIv5 accesses */
+#define PLATFORM_HAS_SWD_QUEUE
+#define ADIV5_QUEUE_LEN 256
+#define PLATFORM_HAS_FREQUENCY
+/* Host memory is plentiful, fewer and larger packets save round trips */
+#ifndef GDB_PACKET_BUFFER_SIZE
+#define GDB_PACKET_BUFFER_SIZE 0x4000
+#endif
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE (1024 * 1024)
+#endif
 
 #define SET_RUN_STATE(state)
 #define SET_IDLE_STATE(state)
@@ -47,6 +58,7 @@ extern struct ftdi_context *ftdic;
 void platform_buffer_flush(void);
 int platform_buffer_write(const uint8_t *data, int size);
 int platform_buffer_read(uint8_t *data, int size);
+void platform_clock_init(uint16_t default_divisor);
 
 typedef struct cable_desc_s {
 	int vendor;
@@ -61,6 +73,13 @@ typedef struct cable_desc_s {
 	uint8_t bitbang_swd_dbus_read_data;
 	/* bitbang_swd_dbus_read_data is same as dbus_data,
 	 * as long as CBUS is not involved.*/
+	uint8_t mpsse_swd_write_data;
+	uint8_t mpsse_swd_write_ddr;
+	uint8_t mpsse_swd_read_data;
+	uint8_t mpsse_swd_read_ddr;
+	/* If mpsse_swd_write_ddr is set, SWDIO is driven from TDI and read
+	 * on TDO, so the data phase uses MPSSE shifts instead of bitbang.
+	 * The values are the DBUS settings for either direction.*/
 	char *description;
 	char * name;
 }cable_desc_t;
@@ -29,15 +29,20 @@
 #include "swdptap.h"
 
 static uint8_t olddir = 0;
+/* SWDIO wired to TDI/TDO, use MPSSE shifts instead of bitbang */
+static bool swd_mpsse;
 
 #define MPSSE_MASK (MPSSE_TDI | MPSSE_TDO | MPSSE_TMS)
 #define MPSSE_TD_MASK (MPSSE_TDI | MPSSE_TDO)
 #define MPSSE_TMS_SHIFT (MPSSE_WRITE_TMS | MPSSE_LSB |\
 						 MPSSE_BITMODE | MPSSE_WRITE_NEG)
+#define MPSSE_TDI_SHIFT (MPSSE_DO_WRITE | MPSSE_LSB | MPSSE_WRITE_NEG)
+#define MPSSE_TDO_SHIFT (MPSSE_DO_READ | MPSSE_LSB)
 
 int swdptap_init(void)
 {
-	if (!active_cable->bitbang_tms_in_pin) {
+	swd_mpsse = active_cable->mpsse_swd_write_ddr != 0;
+	if (!active_cable->bitbang_tms_in_pin && !swd_mpsse) {
 		DEBUG("SWD not possible or missing item in cable description.\n");
 		return -1;
 	}
@@ -61,14 +66,21 @@ int swdptap_init(void)
 			err, ftdi_get_error_string(ftdic));
 		return -1;;
 	}
-	uint8_t ftdi_init[9] = {TCK_DIVISOR, 0x01, 0x00, SET_BITS_LOW, 0,0,
+	uint8_t ftdi_init[6] = {SET_BITS_LOW, 0,0,
 				SET_BITS_HIGH, 0,0};
-	ftdi_init[4]=  active_cable->dbus_data |  MPSSE_MASK;
-	ftdi_init[5]= active_cable->dbus_ddr   & ~MPSSE_TD_MASK;
-	ftdi_init[7]= active_cable->cbus_data;
-	ftdi_init[8]= active_cable->cbus_ddr;
-	platform_buffer_write(ftdi_init, 9);
+	if (swd_mpsse) {
+		ftdi_init[1]= active_cable->mpsse_swd_write_data;
+		ftdi_init[2]= active_cable->mpsse_swd_write_ddr;
+	} else {
+		ftdi_init[1]= active_cable->dbus_data |  MPSSE_MASK;
+		ftdi_init[2]= active_cable->dbus_ddr   & ~MPSSE_TD_MASK;
+	}
+	ftdi_init[4]= active_cable->cbus_data;
+	ftdi_init[5]= active_cable->cbus_ddr;
+	platform_clock_init(1);
+	platform_buffer_write(ftdi_init, 6);
 	platform_buffer_flush();
+	olddir = 0;
 
 	return 0;
 }
@@ -83,21 +95,101 @@ static void swdptap_turnaround(uint8_t dir)
 
 	if(dir)	  { /* SWDIO goes to input */
 		cmd[index++] = SET_BITS_LOW;
-		if (active_cable->bitbang_swd_dbus_read_data)
-			cmd[index] = active_cable->bitbang_swd_dbus_read_data;
-		else
-			cmd[index] = active_cable->dbus_data;
-		index++;
-		cmd[index++] = active_cable->dbus_ddr & ~MPSSE_MASK;
+		if (swd_mpsse) {
+			cmd[index++] = active_cable->mpsse_swd_read_data;
+			cmd[index++] = active_cable->mpsse_swd_read_ddr;
+		} else {
+			if (active_cable->bitbang_swd_dbus_read_data)
+				cmd[index] = active_cable->bitbang_swd_dbus_read_data;
+			else
+				cmd[index] = active_cable->dbus_data;
+			index++;
+			cmd[index++] = active_cable->dbus_ddr & ~MPSSE_MASK;
+		}
 	}
 	/* One clock cycle */
-	cmd[index++] = MPSSE_TMS_SHIFT;
+	cmd[index++] = (swd_mpsse) ? MPSSE_TDI_SHIFT | MPSSE_BITMODE :
+		MPSSE_TMS_SHIFT;
 	cmd[index++] = 0;
 	cmd[index++] = 0;
 	if (!dir) {
 		cmd[index++] = SET_BITS_LOW;
-		cmd[index++] = active_cable->dbus_data |  MPSSE_MASK;
-		cmd[index++] = active_cable->dbus_ddr  & ~MPSSE_TD_MASK;
+		if (swd_mpsse) {
+			cmd[index++] = active_cable->mpsse_swd_write_data;
+			cmd[index++] = active_cable->mpsse_swd_write_ddr;
+		} else {
+			cmd[index++] = active_cable->dbus_data |  MPSSE_MASK;
+			cmd[index++] = active_cable->dbus_ddr  & ~MPSSE_TD_MASK;
+		}
+	}
+	platform_buffer_write(cmd, index);
+}
+
+/* Clock in ticks bits from TDO with byte shifts for the whole bytes and
+ * a bit shift for the rest.  Returns the number of response bytes.
+ */
+static int swdptap_mpsse_in(int ticks)
+{
+	uint8_t cmd[5];
+	int index = 0;
+
+	if (ticks >= 8) {
+		cmd[index++] = MPSSE_TDO_SHIFT;
+		cmd[index++] = (ticks >> 3) - 1;
+		cmd[index++] = 0;
+	}
+	if (ticks & 7) {
+		cmd[index++] = MPSSE_TDO_SHIFT | MPSSE_BITMODE;
+		cmd[index++] = (ticks & 7) - 1;
+	}
+	platform_buffer_write(cmd, index);
+	return (ticks + 7) >> 3;
+}
+
+/* Bit shifts leave the data in the top bits of the last byte */
+static uint32_t swdptap_mpsse_decode(const uint8_t *data, int ticks,
+                                     unsigned int *parity)
+{
+	int bytes = ticks >> 3;
+	int shift = 8 - (ticks & 7);
+	unsigned int p = 0;
+	uint32_t ret = 0;
+
+	for (int i = 0; i < ticks; i++) {
+		unsigned int bit;
+		if (i < (bytes << 3))
+			bit = data[i >> 3] >> (i & 7);
+		else
+			bit = data[bytes] >> (shift + (i & 7));
+		if (bit & 1) {
+			p ^= 1;
+			if (i < 32)
+				ret |= (1u << i);
+		}
+	}
+	if (parity)
+		*parity = p;
+	return ret;
+}
+
+static void swdptap_mpsse_out(uint32_t MS, int ticks)
+{
+	uint8_t cmd[9];
+	int index = 0;
+
+	if (ticks >= 8) {
+		cmd[index++] = MPSSE_TDI_SHIFT;
+		cmd[index++] = (ticks >> 3) - 1;
+		cmd[index++] = 0;
+		for (int i = 0; i < (ticks >> 3); i++) {
+			cmd[index++] = MS & 0xff;
+			MS >>= 8;
+		}
+	}
+	if (ticks & 7) {
+		cmd[index++] = MPSSE_TDI_SHIFT | MPSSE_BITMODE;
+		cmd[index++] = (ticks & 7) - 1;
+		cmd[index++] = MS & 0xff;
 	}
 	platform_buffer_write(cmd, index);
 }
@@ -105,6 +197,12 @@ static void swdptap_turnaround(uint8_t dir)
 bool swdptap_bit_in(void)
 {
 	swdptap_turnaround(1);
+	uint8_t data[1];
+	if (swd_mpsse) {
+		swdptap_mpsse_in(1);
+		platform_buffer_read(data, 1);
+		return swdptap_mpsse_decode(data, 1, NULL);
+	}
 	uint8_t cmd[4];
 	int index = 0;
 
@@ -113,7 +211,6 @@ bool swdptap_bit_in(void)
 	cmd[index++] = 0;
 	cmd[index++] = 0;
 	platform_buffer_write(cmd, index);
-	uint8_t data[1];
 	platform_buffer_read(data, 1);
 	return (data[0] &= active_cable->bitbang_tms_in_pin);
 }
@@ -121,6 +218,10 @@ bool swdptap_bit_in(void)
 void swdptap_bit_out(bool val)
 {
 	swdptap_turnaround(0);
+	if (swd_mpsse) {
+		swdptap_mpsse_out(val, 1);
+		return;
+	}
 	uint8_t cmd[3];
 
 	cmd[0] = MPSSE_TMS_SHIFT;
@@ -135,11 +236,17 @@ bool swdptap_seq_in_parity(uint32_t *res, int ticks)
 	uint8_t cmd[4];
 	unsigned int parity = 0;
 
+	swdptap_turnaround(1);
+	if (swd_mpsse) {
+		uint8_t data[5];
+		platform_buffer_read(data, swdptap_mpsse_in(ticks + 1));
+		*res = swdptap_mpsse_decode(data, ticks + 1, &parity);
+		return parity;
+	}
 	cmd[0] = active_cable->bitbang_tms_in_port_cmd;
 	cmd[1] = MPSSE_TMS_SHIFT;
 	cmd[2] = 0;
 	cmd[3] = 0;
-	swdptap_turnaround(1);
 	while (index--) {
 		platform_buffer_write(cmd, 4);
 	}
@@ -163,12 +270,16 @@ uint32_t swdptap_seq_in(int ticks)
 	int index = ticks;
 	uint8_t cmd[4];
 
+	swdptap_turnaround(1);
+	if (swd_mpsse) {
+		uint8_t data[4];
+		platform_buffer_read(data, swdptap_mpsse_in(ticks));
+		return swdptap_mpsse_decode(data, ticks, NULL);
+	}
 	cmd[0] = active_cable->bitbang_tms_in_port_cmd;
 	cmd[1] = MPSSE_TMS_SHIFT;
 	cmd[2] = 0;
 	cmd[3] = 0;
-
-	swdptap_turnaround(1);
 	while (index--) {
 		platform_buffer_write(cmd, 4);
 	}
@@ -187,6 +298,10 @@ void swdptap_seq_out(uint32_t MS, int ticks)
 	uint8_t cmd[15];
 	unsigned int index = 0;
 	swdptap_turnaround(0);
+	if (swd_mpsse) {
+		swdptap_mpsse_out(MS, ticks);
+		return;
+	}
 	while (ticks) {
 		cmd[index++] = MPSSE_TMS_SHIFT;
 		if (ticks >= 7) {
@@ -211,6 +326,11 @@ void swdptap_seq_out_parity(uint32_t MS, int ticks)
 	unsigned int index = 0;
 	uint32_t data = MS;
 	swdptap_turnaround(0);
+	if (swd_mpsse) {
+		swdptap_mpsse_out(MS, ticks);
+		swdptap_mpsse_out(__builtin_parity(MS), 1);
+		return;
+	}
 	while (steps) {
 		cmd[index++] = MPSSE_TMS_SHIFT;
 		if (steps >= 7) {
@@ -233,3 +353,96 @@ void swdptap_seq_out_parity(uint32_t MS, int ticks)
 	cmd[index++] = parity;
 	platform_buffer_write(cmd, index);
 }
+
+/* Queued input.  Bitbanged, every tick captures one GET_BITS_LOW byte,
+ * with MPSSE shifts eight ticks share a byte.
+ * The chip stalls when it has more to return than its FIFO holds (1 KiB
+ * on the FT232H), so no more than that may be outstanding.  With MPSSE
+ * that is plenty and the queue is fetched with a single
+ * platform_buffer_read().  Bitbanged, a read transfer alone returns 36
+ * bytes, so the queue is sized in transfers and the captured bytes are
+ * fetched whenever a FIFO's worth is outstanding.  That still costs a
+ * round trip per 28 or so transfers.
+ */
+#define SWDPTAP_FIFO_BYTES 1024
+#define SWDPTAP_QUEUE_BYTES (ADIV5_QUEUE_LEN * (3 + 33))
+
+static uint8_t queue_data[SWDPTAP_QUEUE_BYTES];
+static struct {
+	uint16_t offset;
+	uint8_t ticks;
+} queue_token[SWDPTAP_QUEUE_BYTES];
+static int queue_bytes;
+static int queue_fetched;	/* Bytes already read back */
+static int queue_tokens;
+
+bool swdptap_queue_room(int ticks)
+{
+	/* Worst case for MPSSE, two tokens each ending in a partial byte */
+	if (swd_mpsse)
+		return queue_bytes + (ticks >> 3) + 2 <= SWDPTAP_FIFO_BYTES;
+	return queue_bytes + ticks <= SWDPTAP_QUEUE_BYTES;
+}
+
+int swdptap_seq_in_queued(int ticks)
+{
+	int token = queue_tokens++;
+	uint8_t cmd[4];
+
+	queue_token[token].offset = queue_bytes;
+	queue_token[token].ticks = ticks;
+	swdptap_turnaround(1);
+	if (swd_mpsse) {
+		queue_bytes += swdptap_mpsse_in(ticks);
+		return token;
+	}
+
+	if (queue_bytes - queue_fetched + ticks > SWDPTAP_FIFO_BYTES) {
+		platform_buffer_read(queue_data + queue_fetched,
+		                     queue_bytes - queue_fetched);
+		queue_fetched = queue_bytes;
+	}
+	cmd[0] = active_cable->bitbang_tms_in_port_cmd;
+	cmd[1] = MPSSE_TMS_SHIFT;
+	cmd[2] = 0;
+	cmd[3] = 0;
+	for (int i = 0; i < ticks; i++)
+		platform_buffer_write(cmd, 4);
+	queue_bytes += ticks;
+	return token;
+}
+
+void swdptap_queue_run(void)
+{
+	if (queue_bytes > queue_fetched)
+		platform_buffer_read(queue_data + queue_fetched,
+		                     queue_bytes - queue_fetched);
+	else
+		platform_buffer_flush();
+	queue_bytes = 0;
+	queue_fetched = 0;
+	queue_tokens = 0;
+}
+
+uint32_t swdptap_queue_result(int token, bool *parity)
+{
+	const uint8_t *data = &queue_data[queue_token[token].offset];
+	int ticks = queue_token[token].ticks;
+	unsigned int p = 0;
+	uint32_t ret = 0;
+
+	if (swd_mpsse) {
+		ret = swdptap_mpsse_decode(data, ticks, &p);
+	} else {
+		for (int i = 0; i < ticks; i++) {
+			if (data[i] & active_cable->bitbang_tms_in_pin) {
+				p ^= 1;
+				if (i < 32)
+					ret |= (1u << i);
+			}
+		}
+	}
+	if (parity)
+		*parity = p;
+	return ret;
+}
@@ -225,8 +225,10 @@ void adiv5_ap_ref(ADIv5_AP_t *ap)
 
 void adiv5_dp_unref(ADIv5_DP_t *dp)
 {
-	if (--(dp->refcnt) == 0)
+	if (--(dp->refcnt) == 0) {
+		free(dp->queue);
 		free(dp);
+	}
 }
 
 void adiv5_ap_unref(ADIv5_AP_t *ap)
@@ -239,7 +241,49 @@ void adiv5_ap_unref(ADIv5_AP_t *ap)
 
 void adiv5_dp_write(ADIv5_DP_t *dp, uint16_t addr, uint32_t value)
 {
-	dp->low_access(dp, ADIV5_LOW_WRITE, addr, value);
+	if (addr == ADIV5_DP_SELECT) {
+		dp->select = value;
+		dp->select_valid = true;
+	}
+	adiv5_dp_low_access(dp, ADIV5_LOW_WRITE, addr, value);
+}
+
+/* Queue a low level access.  On DPs that can batch, the access is only
+ * performed on the next adiv5_dp_queue_flush(), which is also when read
+ * data is stored to *result.  Any direct access flushes the queue first,
+ * so ordering is always preserved.  Errors are reported exactly as for
+ * adiv5_dp_low_access(), but may be raised from the flush.
+ */
+void adiv5_dp_queue(ADIv5_DP_t *dp, uint8_t RnW, uint16_t addr,
+                    uint32_t value, uint32_t *result)
+{
+	if (dp->queue_run == NULL) {
+		uint32_t ret = dp->low_access(dp, RnW, addr, value);
+		if (result)
+			*result = ret;
+		return;
+	}
+
+	if (dp->queue == NULL)
+		dp->queue = malloc(sizeof(*dp->queue) * ADIV5_QUEUE_LEN);
+	if (dp->queue_len == ADIV5_QUEUE_LEN)
+		adiv5_dp_queue_flush(dp);
+
+	struct adiv5_queue_entry *q = &dp->queue[dp->queue_len++];
+	q->RnW = RnW;
+	q->addr = addr;
+	q->value = value;
+	q->result = result;
+}
+
+void adiv5_dp_queue_flush(ADIv5_DP_t *dp)
+{
+	size_t n = dp->queue_len;
+	if (n == 0)
+		return;
+	/* Empty the queue first, we may not come back if this raises */
+	dp->queue_len = 0;
+	dp->queue_run(dp, dp->queue, n);
 }
 
 static uint32_t adiv5_mem_read32(ADIv5_AP_t *ap, uint32_t addr)
@@ -357,6 +401,55 @@ static bool adiv5_component_probe(ADIv5_AP_t *ap, uint32_t addr)
 	return res;
 }
 
+/* The TAR auto-increment is only guaranteed within 1 KiB, but many MEM-APs
+ * carry on up to 4 KiB.  The ROM table is known to be readable, so read the
+ * last word before each boundary there and check if TAR wrapped.
+ */
+static uint32_t adiv5_ap_tar_window(ADIv5_AP_t *ap)
+{
+	uint32_t base = ap->base & 0xfffff000;
+	volatile uint32_t window = 0x400;
+
+	if ((ADIV5_AP_IDR_CLASS(ap->idr) != ADIV5_AP_IDR_CLASS_MEM) ||
+	    (ap->base == 0xffffffff))
+		return window;
+
+	volatile struct exception e;
+	TRY_CATCH (e, EXCEPTION_ALL) {
+		adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw |
+		               ADIV5_AP_CSW_SIZE_WORD | ADIV5_AP_CSW_ADDRINC_SINGLE);
+		for (uint32_t w = 0x400; w < 0x1000; w <<= 1) {
+			adiv5_ap_write(ap, ADIV5_AP_TAR, base + w - 4);
+			adiv5_ap_read(ap, ADIV5_AP_DRW);
+			if (adiv5_ap_read(ap, ADIV5_AP_TAR) != base + w)
+				break;
+			window = w << 1;
+		}
+	}
+	if (e.type || adiv5_dp_error(ap->dp))
+		return 0x400;
+	return window;
+}
+
+/* Packed transfers are optional, an AP without them does not accept
+ * ADDRINC_PACKED in CSW.  Try it and see what reads back.
+ */
+static bool adiv5_ap_packed(ADIv5_AP_t *ap)
+{
+	const uint32_t mask = ADIV5_AP_CSW_SIZE_MASK | ADIV5_AP_CSW_ADDRINC_MASK;
+	const uint32_t packed = ADIV5_AP_CSW_SIZE_BYTE | ADIV5_AP_CSW_ADDRINC_PACKED;
+
+	if (ADIV5_AP_IDR_CLASS(ap->idr) != ADIV5_AP_IDR_CLASS_MEM)
+		return false;
+
+	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | packed);
+	bool ret = (adiv5_ap_read(ap, ADIV5_AP_CSW) & mask) == packed;
+	/* Leave CSW in a known state, the cache holds the value written */
+	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD |
+	               ADIV5_AP_CSW_ADDRINC_SINGLE);
+	return ret;
+}
+
 ADIv5_AP_t *adiv5_new_ap(ADIv5_DP_t *dp, uint8_t apsel)
 {
 	ADIv5_AP_t *ap, tmpap;
@@ -384,9 +477,13 @@ ADIv5_AP_t *adiv5_new_ap(ADIv5_DP_t *dp, uint8_t apsel)
 		DEBUG("AP transaction in progress.  Target may not be usable.\n");
 		ap->csw &= ~ADIV5_AP_CSW_TRINPROG;
 	}
+	ap->tar_window = adiv5_ap_tar_window(ap);
+	ap->packed = adiv5_ap_packed(ap);
 
-	DEBUG(" AP %3d: IDR=%08"PRIx32" CFG=%08"PRIx32" BASE=%08"PRIx32" CSW=%08"PRIx32"\n",
-	      apsel, ap->idr, ap->cfg, ap->base, ap->csw);
+	DEBUG(" AP %3d: IDR=%08"PRIx32" CFG=%08"PRIx32" BASE=%08"PRIx32" CSW=%08"PRIx32
+	      " TAR window=%"PRIx32"%s\n",
+	      apsel, ap->idr, ap->cfg, ap->base, ap->csw, ap->tar_window,
+	      ap->packed ? " packed" : "");
 
 	return ap;
 }
@@ -398,6 +495,7 @@ void adiv5_dp_init(ADIv5_DP_t *dp)
 	volatile uint32_t ctrlstat = 0;
 
 	adiv5_dp_ref(dp);
+	adiv5_dp_cache_invalidate(dp);
 
 	volatile struct exception e;
 	TRY_CATCH (e, EXCEPTION_TIMEOUT) {
@@ -480,13 +578,12 @@ void adiv5_dp_init(ADIv5_DP_t *dp)
 	adiv5_dp_unref(dp);
 }
 
-#define ALIGNOF(x) (((x) & 3) == 0 ? ALIGN_WORD : \
-                    (((x) & 1) == 0 ? ALIGN_HALFWORD : ALIGN_BYTE))
-
 /* Program the CSW and TAR for sequencial access at a given width */
-static void ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align)
+static void ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align,
+                                bool packed)
 {
-	uint32_t csw = ap->csw | ADIV5_AP_CSW_ADDRINC_SINGLE;
+	uint32_t csw = ap->csw | (packed ? ADIV5_AP_CSW_ADDRINC_PACKED :
+	                                   ADIV5_AP_CSW_ADDRINC_SINGLE);
 
 	switch (align) {
 	case ALIGN_BYTE:
@@ -500,8 +597,8 @@ static void ap_mem_access_setup(ADIv5_AP_t *ap, uint32_t addr, enum align align)
 		csw |= ADIV5_AP_CSW_SIZE_WORD;
 		break;
 	}
-	adiv5_ap_write(ap, ADIV5_AP_CSW, csw);
-	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, addr);
+	adiv5_ap_queue_write(ap, ADIV5_AP_CSW, csw);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, addr, NULL);
 }
 
 /* Extract read data from data lane based on align and src address */
@@ -511,46 +608,116 @@ static void * extract(void *dest, uint32_t src, uint32_t val, enum align align)
 	case ALIGN_BYTE:
 		*(uint8_t *)dest = (val >> ((src & 0x3) << 3) & 0xFF);
 		break;
-	case ALIGN_HALFWORD:
-		*(uint16_t *)dest = (val >> ((src & 0x2) << 3) & 0xFFFF);
+	case ALIGN_HALFWORD: {
+		uint16_t tmp = val >> ((src & 0x2) << 3) & 0xFFFF;
+		memcpy(dest, &tmp, sizeof(tmp));
 		break;
+	}
 	case ALIGN_DWORD:
 	case ALIGN_WORD:
-		*(uint32_t *)dest = val;
+		memcpy(dest, &val, sizeof(val));
 		break;
 	}
 	return (uint8_t *)dest + (1 << align);
 }
 
-void
-adiv5_mem_read(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
+/* Split off the next chunk of a transfer: a byte and/or halfword head to
+ * reach word alignment, a word aligned body and a halfword and/or byte
+ * tail.  Unaligned requests still do the bulk of the work in words.
+ */
+static enum align mem_next_chunk(uint32_t addr, size_t len, size_t *chunk)
 {
-	uint32_t tmp;
+	if ((addr & 1) || (len == 1)) {
+		*chunk = 1;
+		return ALIGN_BYTE;
+	}
+	if ((addr & 2) || (len < 4)) {
+		*chunk = 2;
+		return ALIGN_HALFWORD;
+	}
+	*chunk = len & ~3;
+	return ALIGN_WORD;
+}
+
+/* Byte and halfword transfers can be packed, so each DRW access moves a
+ * whole word.  Only used for whole words from a word aligned address, so
+ * every access fills all byte lanes.
+ */
+static bool mem_use_packed(ADIv5_AP_t *ap, uint32_t addr, size_t len,
+                           enum align align)
+{
+	return ap->packed && (align < ALIGN_WORD) && !(addr & 3) && (len >= 4);
+}
+
+static void
+adiv5_mem_read_sized(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len,
+                     enum align align)
+{
+	uint32_t data[ADIV5_QUEUE_LEN];
 	uint32_t osrc = src;
-	enum align align = MIN(ALIGNOF(src), ALIGNOF(len));
 
-	if (len == 0)
-		return;
+	/* Only ever a single byte or halfword or a run of words, see
+	 * mem_next_chunk(), so packing wouldn't save any accesses */
+	ap_mem_access_setup(ap, src, align, false);
 
 	len >>= align;
-	ap_mem_access_setup(ap, src, align);
-	adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
-	while (--len) {
-		tmp = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
-		dest = extract(dest, src, tmp, align);
-
-		src += (1 << align);
-		/* Check for 10 bit address overflow */
-		if ((src ^ osrc) & 0xfffffc00) {
-			osrc = src;
-			adiv5_dp_low_access(ap->dp,
-					ADIV5_LOW_WRITE, ADIV5_AP_TAR, src);
-			adiv5_dp_low_access(ap->dp,
-					ADIV5_LOW_READ, ADIV5_AP_DRW, 0);
+	/* Reads are posted, the first one only starts the transfer */
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0, NULL);
+	while (len) {
+		/* Queue up a block, the data lands in data[] on flush */
+		size_t n = MIN(len, ADIV5_QUEUE_LEN);
+		uint32_t bsrc = src;
+		for (size_t i = 0; i < n; i++) {
+			if (--len == 0) {
+				adiv5_dp_queue(ap->dp, ADIV5_LOW_READ,
+				               ADIV5_DP_RDBUFF, 0, &data[i]);
+				break;
+			}
+			adiv5_dp_queue(ap->dp, ADIV5_LOW_READ,
+			               ADIV5_AP_DRW, 0, &data[i]);
+			src += (1 << align);
+			/* Check for TAR auto-increment overflow */
+			if ((src ^ osrc) & ~(ap->tar_window - 1)) {
+				osrc = src;
+				adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE,
+				               ADIV5_AP_TAR, src, NULL);
+				adiv5_dp_queue(ap->dp, ADIV5_LOW_READ,
+				               ADIV5_AP_DRW, 0, NULL);
+			}
+		}
+		adiv5_dp_queue_flush(ap->dp);
+		for (size_t i = 0; i < n; i++) {
+			dest = extract(dest, bsrc, data[i], align);
+			bsrc += (1 << align);
 		}
 	}
-	tmp = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF, 0);
-	extract(dest, src, tmp, align);
+}
+
+void
+adiv5_mem_read(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len)
+{
+	while (len) {
+		size_t chunk;
+		enum align align = mem_next_chunk(src, len, &chunk);
+		adiv5_mem_read_sized(ap, dest, src, chunk, align);
+		dest = (uint8_t *)dest + chunk;
+		src += chunk;
+		len -= chunk;
+	}
+}
+
+/* Queue a single word read, *result is valid after adiv5_dp_queue_flush() */
+void adiv5_mem_queue_read32(ADIv5_AP_t *ap, uint32_t addr, uint32_t *result)
+{
+	ap_mem_access_setup(ap, addr, ALIGN_WORD, false);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DRW, 0, NULL);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF, 0, result);
+}
+
+void adiv5_mem_queue_write32(ADIv5_AP_t *ap, uint32_t addr, uint32_t value)
+{
+	ap_mem_access_setup(ap, addr, ALIGN_WORD, false);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DRW, value, NULL);
 }
 
 void
@@ -558,9 +725,19 @@ adiv5_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src,
 					  size_t len, enum align align)
 {
 	uint32_t odest = dest;
+	enum align rest_align = align;
+	size_t rest = 0;
+
+	if (mem_use_packed(ap, dest, len, align)) {
+		ap_mem_access_setup(ap, dest, align, true);
+		rest = len & 3;
+		len &= ~3;
+		align = ALIGN_WORD;
+	} else {
+		ap_mem_access_setup(ap, dest, align, false);
+	}
 
 	len >>= align;
-	ap_mem_access_setup(ap, dest, align);
 	while (len--) {
 		uint32_t tmp = 0;
 		/* Pack data into correct data lane */
@@ -568,46 +745,101 @@ adiv5_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src,
 		case ALIGN_BYTE:
 			tmp = ((uint32_t)*(uint8_t *)src) << ((dest & 3) << 3);
 			break;
-		case ALIGN_HALFWORD:
-			tmp = ((uint32_t)*(uint16_t *)src) << ((dest & 2) << 3);
+		case ALIGN_HALFWORD: {
+			uint16_t h;
+			memcpy(&h, src, sizeof(h));
+			tmp = ((uint32_t)h) << ((dest & 2) << 3);
 			break;
+		}
 		case ALIGN_DWORD:
 		case ALIGN_WORD:
-			tmp = *(uint32_t *)src;
+			memcpy(&tmp, src, sizeof(tmp));
 			break;
 		}
 		src = (uint8_t *)src + (1 << align);
 		dest += (1 << align);
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DRW, tmp);
+		adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DRW, tmp, NULL);
 
-		/* Check for 10 bit address overflow */
-		if ((dest ^ odest) & 0xfffffc00) {
+		/* Check for TAR auto-increment overflow */
+		if ((dest ^ odest) & ~(ap->tar_window - 1)) {
 			odest = dest;
-			adiv5_dp_low_access(ap->dp,
-					ADIV5_LOW_WRITE, ADIV5_AP_TAR, dest);
+			adiv5_dp_queue(ap->dp,
+					ADIV5_LOW_WRITE, ADIV5_AP_TAR, dest, NULL);
 		}
 	}
+	if (rest)
+		adiv5_mem_write_sized(ap, dest, src, rest, rest_align);
+	adiv5_dp_queue_flush(ap->dp);
 }
 
 void
 adiv5_mem_write(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_t len)
 {
-	enum align align = MIN(ALIGNOF(dest), ALIGNOF(len));
-	adiv5_mem_write_sized(ap, dest, src, len, align);
+	while (len) {
+		size_t chunk;
+		enum align align = mem_next_chunk(dest, len, &chunk);
+		adiv5_mem_write_sized(ap, dest, src, chunk, align);
+		src = (const uint8_t *)src + chunk;
+		dest += chunk;
+		len -= chunk;
+	}
+}
+
+/* Select the AP register bank, unless SELECT already points there */
+static void adiv5_ap_select(ADIv5_AP_t *ap, uint16_t addr)
+{
+	ADIv5_DP_t *dp = ap->dp;
+	uint32_t select = ((uint32_t)ap->apsel << 24) | (addr & 0xF0);
+
+	if (dp->select_valid && (dp->select == select))
+		return;
+	adiv5_dp_queue(dp, ADIV5_LOW_WRITE, ADIV5_DP_SELECT, select, NULL);
+	dp->select = select;
+	dp->select_valid = true;
+}
+
+/* Returns true if the write is redundant because CSW already holds value */
+static bool adiv5_ap_csw_cached(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
+{
+	if (addr != ADIV5_AP_CSW)
+		return false;
+	if ((ap->csw_gen == ap->dp->cache_gen) && (ap->csw_cur == value))
+		return true;
+	ap->csw_cur = value;
+	ap->csw_gen = ap->dp->cache_gen;
+	return false;
 }
 
 void adiv5_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
 {
-	adiv5_dp_write(ap->dp, ADIV5_DP_SELECT,
-			((uint32_t)ap->apsel << 24)|(addr & 0xF0));
+	adiv5_ap_select(ap, addr);
+	if (adiv5_ap_csw_cached(ap, addr, value))
+		return;
 	adiv5_dp_write(ap->dp, addr, value);
 }
 
 uint32_t adiv5_ap_read(ADIv5_AP_t *ap, uint16_t addr)
 {
 	uint32_t ret;
-	adiv5_dp_write(ap->dp, ADIV5_DP_SELECT,
-			((uint32_t)ap->apsel << 24)|(addr & 0xF0));
+	adiv5_ap_select(ap, addr);
 	ret = adiv5_dp_read(ap->dp, addr);
 	return ret;
 }
+
+void adiv5_ap_queue_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value)
+{
+	/* Select even if the write is skipped, callers go on to
+	 * write TAR and DRW directly */
+	adiv5_ap_select(ap, addr);
+	if (adiv5_ap_csw_cached(ap, addr, value))
+		return;
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, addr, value, NULL);
+}
+
+/* AP reads are posted, the data is picked up from RDBUFF */
+void adiv5_ap_queue_read(ADIv5_AP_t *ap, uint16_t addr, uint32_t *result)
+{
+	adiv5_ap_select(ap, addr);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, addr, 0, NULL);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF, 0, result);
+}
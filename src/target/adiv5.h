@@ -85,6 +85,9 @@
 #define ADIV5_AP_CFG		ADIV5_AP_REG(0xF4)
 #define ADIV5_AP_BASE		ADIV5_AP_REG(0xF8)
 #define ADIV5_AP_IDR		ADIV5_AP_REG(0xFC)
+/* AP Identification Register (IDR) */
+#define ADIV5_AP_IDR_CLASS(x)	(((x) >> 13) & 0xf)
+#define ADIV5_AP_IDR_CLASS_MEM	8
 
 /* AP Control and Status Word (CSW) */
 #define ADIV5_AP_CSW_DBGSWENABLE	(1u << 31)
@@ -117,6 +120,18 @@ enum align {
 	ALIGN_DWORD    = 3
 };
 
+/* Queued DP/AP access, see adiv5_dp_queue() */
+#ifndef ADIV5_QUEUE_LEN
+#define ADIV5_QUEUE_LEN 16
+#endif
+
+struct adiv5_queue_entry {
+	uint8_t RnW;
+	uint16_t addr;
+	uint32_t value;
+	uint32_t *result;
+};
+
 /* Try to keep this somewhat absract for later adding SW-DP */
 typedef struct ADIv5_DP_s {
 	int refcnt;
@@ -130,31 +145,84 @@ typedef struct ADIv5_DP_s {
 	uint32_t (*low_access)(struct ADIv5_DP_s *dp, uint8_t RnW,
                                uint16_t addr, uint32_t value);
 	void (*abort)(struct ADIv5_DP_s *dp, uint32_t abort);
+	/* Optional, performs a batch of queued accesses in one transfer.
+	 * If NULL, queued accesses are executed immediately. */
+	void (*queue_run)(struct ADIv5_DP_s *dp,
+	                  struct adiv5_queue_entry *q, size_t n);
+
+	struct adiv5_queue_entry *queue;
+	size_t queue_len;
+
+	/* Last value written to SELECT, to skip redundant writes.
+	 * Bumping cache_gen also invalidates the CSW cache of all APs. */
+	bool select_valid;
+	uint32_t select;
+	uint32_t cache_gen;
 
 	union {
 		jtag_dev_t *dev;
 		uint8_t fault;
 	};
+	/* SW-DP: CTRL/STAT.ORUNDETECT is set, a data phase always follows
+	 * the ACK */
+	bool orundetect;
+	/* How long (ms) a single access retries WAIT responses before
+	 * raising EXCEPTION_TIMEOUT, 0 for ADIV5_DP_WAIT_TIMEOUT */
+	uint32_t wait_timeout;
+	/* SW-DP: non-OK ACKs seen, retried or replayed ones included */
+	uint32_t ack_errors;
 } ADIv5_DP_t;
 
+#define ADIV5_DP_WAIT_TIMEOUT 2000
+
+static inline uint32_t adiv5_dp_wait_timeout(ADIv5_DP_t *dp)
+{
+	return dp->wait_timeout ? dp->wait_timeout : ADIV5_DP_WAIT_TIMEOUT;
+}
+
+void adiv5_dp_queue(ADIv5_DP_t *dp, uint8_t RnW, uint16_t addr,
+                    uint32_t value, uint32_t *result);
+void adiv5_dp_queue_flush(ADIv5_DP_t *dp);
+
+/* Forget the cached SELECT and CSW values, after anything that may
+ * have left the DAP in an unknown state. */
+static inline void adiv5_dp_cache_invalidate(ADIv5_DP_t *dp)
+{
+	dp->select_valid = false;
+	dp->cache_gen++;
+}
+
+/* Direct accesses must not overtake anything still sitting in the queue */
 static inline uint32_t adiv5_dp_read(ADIv5_DP_t *dp, uint16_t addr)
 {
+	if (dp->queue_len)
+		adiv5_dp_queue_flush(dp);
 	return dp->dp_read(dp, addr);
 }
 
 static inline uint32_t adiv5_dp_error(ADIv5_DP_t *dp)
 {
-	return dp->error(dp);
+	if (dp->queue_len)
+		adiv5_dp_queue_flush(dp);
+	uint32_t err = dp->error(dp);
+	if (err)
+		adiv5_dp_cache_invalidate(dp);
+	return err;
 }
 
 static inline uint32_t adiv5_dp_low_access(struct ADIv5_DP_s *dp, uint8_t RnW,
                                            uint16_t addr, uint32_t value)
 {
+	if (dp->queue_len)
+		adiv5_dp_queue_flush(dp);
 	return dp->low_access(dp, RnW, addr, value);
 }
 
 static inline void adiv5_dp_abort(struct ADIv5_DP_s *dp, uint32_t abort)
 {
+	if (dp->queue_len)
+		adiv5_dp_queue_flush(dp);
+	adiv5_dp_cache_invalidate(dp);
 	return dp->abort(dp, abort);
 }
 
@@ -168,6 +236,14 @@ typedef struct ADIv5_AP_s {
 	uint32_t cfg;
 	uint32_t base;
 	uint32_t csw;
+	/* TAR auto-increment window, TAR is rewritten when crossing it */
+	uint32_t tar_window;
+	/* Packed byte/halfword transfers supported */
+	bool packed;
+
+	/* Last value written to CSW, valid while csw_gen == dp->cache_gen */
+	uint32_t csw_cur;
+	uint32_t csw_gen;
 } ADIv5_AP_t;
 
 void adiv5_dp_init(ADIv5_DP_t *dp);
@@ -181,10 +257,18 @@ void adiv5_ap_unref(ADIv5_AP_t *ap);
 
 void adiv5_ap_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value);
 uint32_t adiv5_ap_read(ADIv5_AP_t *ap, uint16_t addr);
+void adiv5_ap_queue_write(ADIv5_AP_t *ap, uint16_t addr, uint32_t value);
+void adiv5_ap_queue_read(ADIv5_AP_t *ap, uint16_t addr, uint32_t *result);
 
 void adiv5_jtag_dp_handler(jtag_dev_t *dev);
 
+#if defined(PLATFORM_HAS_FREQUENCY)
+uint32_t adiv5_swdp_calibrate(ADIv5_AP_t *ap, uint32_t ram, size_t len);
+#endif
+
 void adiv5_mem_read(ADIv5_AP_t *ap, void *dest, uint32_t src, size_t len);
+void adiv5_mem_queue_read32(ADIv5_AP_t *ap, uint32_t addr, uint32_t *result);
+void adiv5_mem_queue_write32(ADIv5_AP_t *ap, uint32_t addr, uint32_t value);
 void adiv5_mem_write(ADIv5_AP_t *ap, uint32_t dest, const void *src, size_t len);
 void adiv5_mem_write_sized(ADIv5_AP_t *ap, uint32_t dest, const void *src,
 						   size_t len, enum align align);
@@ -88,12 +88,15 @@ static uint32_t adiv5_jtagdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
 
 	jtag_dev_write_ir(dp->dev, APnDP ? IR_APACC : IR_DPACC);
 
-	platform_timeout_set(&timeout, 2000);
+	platform_timeout_set(&timeout, adiv5_dp_wait_timeout(dp));
 	do {
 		jtag_dev_shift_dr(dp->dev, (uint8_t*)&response, (uint8_t*)&request, 35);
 		ack = response & 0x07;
 	} while(!platform_timeout_is_expired(&timeout) && (ack == JTAGDP_ACK_WAIT));
 
+	if (ack != JTAGDP_ACK_OK)
+		adiv5_dp_cache_invalidate(dp);
+
 	if (ack == JTAGDP_ACK_WAIT)
 		raise_exception(EXCEPTION_TIMEOUT, "JTAG-DP ACK timeout");
 
@@ -42,6 +42,11 @@ static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
 
 static void adiv5_swdp_abort(ADIv5_DP_t *dp, uint32_t abort);
 
+#if defined(PLATFORM_HAS_SWD_QUEUE)
+static void adiv5_swdp_queue_run(ADIv5_DP_t *dp,
+                                 struct adiv5_queue_entry *q, size_t n);
+#endif
+
 int adiv5_swdp_scan(void)
 {
 	uint32_t ack;
@@ -76,8 +81,19 @@ int adiv5_swdp_scan(void)
 	dp->error = adiv5_swdp_error;
 	dp->low_access = adiv5_swdp_low_access;
 	dp->abort = adiv5_swdp_abort;
+#if defined(PLATFORM_HAS_SWD_QUEUE)
+	dp->queue_run = adiv5_swdp_queue_run;
+#endif
 
 	adiv5_swdp_error(dp);
+#if defined(PLATFORM_HAS_SWD_QUEUE)
+	/* With overrun detection, batches can be streamed without looking
+	 * at each ACK, see adiv5_swdp_queue_batch() */
+	uint32_t ctrlstat = adiv5_swdp_read(dp, ADIV5_DP_CTRLSTAT);
+	adiv5_dp_write(dp, ADIV5_DP_CTRLSTAT,
+	               ctrlstat | ADIV5_DP_CTRLSTAT_ORUNDETECT);
+	dp->orundetect = true;
+#endif
 	adiv5_dp_init(dp);
 
 	return target_list?1:0;
@@ -117,17 +133,10 @@ static uint32_t adiv5_swdp_error(ADIv5_DP_t *dp)
 	return err;
 }
 
-static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
-				      uint16_t addr, uint32_t value)
+static uint8_t adiv5_swdp_request(uint8_t RnW, uint16_t addr)
 {
 	bool APnDP = addr & ADIV5_APnDP;
-	addr &= 0xff;
-	uint32_t request = 0x81;
-	uint32_t response = 0;
-	uint32_t ack;
-	platform_timeout timeout;
-
-	if(APnDP && dp->fault) return 0;
+	uint8_t request = 0x81;
 
 	if(APnDP) request ^= 0x22;
 	if(RnW)   request ^= 0x24;
@@ -137,12 +146,45 @@ static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
 	if((addr == 4) || (addr == 8))
 		request ^= 0x20;
 
-	platform_timeout_set(&timeout, 2000);
+	return request;
+}
+
+static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
+				      uint16_t addr, uint32_t value)
+{
+	bool APnDP = addr & ADIV5_APnDP;
+	uint32_t request = adiv5_swdp_request(RnW, addr);
+	uint32_t response = 0;
+	uint32_t ack;
+	platform_timeout timeout;
+
+	if(APnDP && dp->fault) return 0;
+
+	platform_timeout_set(&timeout, adiv5_dp_wait_timeout(dp));
 	do {
 		swdptap_seq_out(request, 8);
 		ack = swdptap_seq_in(3);
+		if (ack != SWDP_ACK_OK)
+			dp->ack_errors++;
+		if (dp->orundetect &&
+		    ((ack == SWDP_ACK_WAIT) || (ack == SWDP_ACK_FAULT))) {
+			/* The data phase happens regardless */
+			if (RnW)
+				swdptap_seq_in_parity(&response, 32);
+			else
+				swdptap_seq_out_parity(0, 32);
+			response = 0;
+			/* A WAIT leaves STICKYORUN set, clear it to retry */
+			if (ack == SWDP_ACK_WAIT)
+				adiv5_swdp_low_access(dp, ADIV5_LOW_WRITE,
+				                      ADIV5_DP_ABORT,
+				                      ADIV5_DP_ABORT_ORUNERRCLR);
+		}
 	} while (ack == SWDP_ACK_WAIT && !platform_timeout_is_expired(&timeout));
 
+	if (ack != SWDP_ACK_OK)
+		adiv5_dp_cache_invalidate(dp);
+
 	if (ack == SWDP_ACK_WAIT)
 		raise_exception(EXCEPTION_TIMEOUT, "SWDP ACK timeout");
 
@@ -155,8 +197,10 @@ static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
 		raise_exception(EXCEPTION_ERROR, "SWDP invalid ACK");
 
 	if(RnW) {
-		if(swdptap_seq_in_parity(&response, 32))  /* Give up on parity error */
+		if(swdptap_seq_in_parity(&response, 32)) {  /* Give up on parity error */
+			adiv5_dp_cache_invalidate(dp);
 			raise_exception(EXCEPTION_ERROR, "SWDP Parity error");
+		}
 	} else {
 		swdptap_seq_out_parity(value, 32);
 		/* RM0377 Rev. 8 Chapter 27.5.4 for STM32L0x1 states:
@@ -180,3 +224,215 @@ static void adiv5_swdp_abort(ADIv5_DP_t *dp, uint32_t abort)
 	adiv5_dp_write(dp, ADIV5_DP_ABORT, abort);
 }
 
+static void adiv5_swdp_line_reset(ADIv5_DP_t *dp)
+{
+	adiv5_dp_cache_invalidate(dp);
+	swdptap_seq_out(0xFFFFFFFF, 32);
+	swdptap_seq_out(0x0FFFFFFF, 32);
+	/* A line reset leaves the DP in reset state until IDCODE is read */
+	adiv5_swdp_low_access(dp, ADIV5_LOW_READ, ADIV5_DP_IDCODE, 0);
+}
+
+#if defined(PLATFORM_HAS_SWD_QUEUE)
+/* Batched transfers for probes where every read is a round trip to the
+ * hardware.  All requests are clocked out assuming an OK ACK, and the ACKs
+ * and read data are only looked at once the whole batch has completed.
+ * With overrun detection the DP stays in step after a WAIT or FAULT, and
+ * FAULTs all AP accesses until the sticky flag is cleared, so everything
+ * from the first failed request on can simply be replayed.
+ */
+static size_t adiv5_swdp_queue_batch(ADIv5_DP_t *dp,
+                                     struct adiv5_queue_entry *q, size_t n)
+{
+	int ack[n], data[n];
+	size_t i;
+
+	for (i = 0; (i < n) && swdptap_queue_room(3 + 33); i++) {
+		swdptap_seq_out(adiv5_swdp_request(q[i].RnW, q[i].addr), 8);
+		ack[i] = swdptap_seq_in_queued(3);
+		if (q[i].RnW) {
+			data[i] = swdptap_seq_in_queued(33);
+		} else {
+			swdptap_seq_out_parity(q[i].value, 32);
+			/* Idle cycles as in adiv5_swdp_low_access(), only
+			 * needed for DP writes when streaming */
+			if (!dp->orundetect || !(q[i].addr & ADIV5_APnDP))
+				swdptap_seq_out(0, 2);
+		}
+	}
+	swdptap_queue_run();
+
+	size_t done = i;
+	for (i = 0; i < done; i++) {
+		uint32_t ack_i = swdptap_queue_result(ack[i], NULL);
+		if (ack_i != SWDP_ACK_OK) {
+			dp->ack_errors++;
+			if (dp->orundetect && (ack_i == SWDP_ACK_WAIT)) {
+				adiv5_dp_cache_invalidate(dp);
+				adiv5_swdp_low_access(dp, ADIV5_LOW_WRITE,
+				                      ADIV5_DP_ABORT,
+				                      ADIV5_DP_ABORT_ORUNERRCLR);
+			} else if (dp->orundetect && (ack_i == SWDP_ACK_FAULT)) {
+				/* Leave STICKYERR for adiv5_dp_error() */
+				adiv5_dp_cache_invalidate(dp);
+			} else {
+				/* Anything clocked after a WAIT or FAULT has
+				 * left the DP confused.  Resynchronise. */
+				adiv5_swdp_line_reset(dp);
+			}
+			/* Let the unbatched path sort out the rest */
+			for (; i < done; i++) {
+				uint32_t ret = adiv5_swdp_low_access(dp,
+					q[i].RnW, q[i].addr, q[i].value);
+				if (q[i].result)
+					*q[i].result = ret;
+			}
+			break;
+		}
+		if (q[i].RnW) {
+			bool parity;
+			uint32_t ret = swdptap_queue_result(data[i], &parity);
+			if (parity) {
+				adiv5_dp_cache_invalidate(dp);
+				raise_exception(EXCEPTION_ERROR, "SWDP Parity error");
+			}
+			if (q[i].result)
+				*q[i].result = ret;
+		}
+	}
+	return done;
+}
+
+static void adiv5_swdp_queue_run(ADIv5_DP_t *dp,
+                                 struct adiv5_queue_entry *q, size_t n)
+{
+	while (n) {
+		size_t done;
+		if (dp->fault) {
+			/* AP accesses are refused without bus traffic
+			 * until the FAULT is cleared, no point batching */
+			uint32_t ret = adiv5_swdp_low_access(dp,
+				q->RnW, q->addr, q->value);
+			if (q->result)
+				*q->result = ret;
+			done = 1;
+		} else {
+			done = adiv5_swdp_queue_batch(dp, q, n);
+		}
+		q += done;
+		n -= done;
+	}
+}
+#endif
+
+#if defined(PLATFORM_HAS_FREQUENCY)
+/* Clock calibration, see adiv5_swdp_calibrate() */
+uint32_t swdp_calibrated_frequency;
+
+static const uint32_t swdp_calibrate_freqs[] = {
+	500000, 1000000, 2000000, 3000000, 4000000, 6000000,
+	8000000, 10000000, 12000000, 15000000, 20000000, 30000000,
+};
+
+#define SWDP_CALIBRATE_WORDS 64
+#define SWDP_CALIBRATE_IDCODES 16
+
+static bool adiv5_swdp_calibrate_step(ADIv5_AP_t *ap, uint32_t ram,
+                                      const uint32_t *pattern, size_t words)
+{
+	ADIv5_DP_t *dp = ap->dp;
+	uint32_t readback[SWDP_CALIBRATE_WORDS];
+	volatile bool ok = true;
+	volatile struct exception e;
+
+	dp->ack_errors = 0;
+	TRY_CATCH (e, EXCEPTION_ALL) {
+		for (int i = 0; i < SWDP_CALIBRATE_IDCODES; i++)
+			if (adiv5_dp_read(dp, ADIV5_DP_IDCODE) != dp->idcode)
+				ok = false;
+		adiv5_mem_write(ap, ram, pattern, words * 4);
+		adiv5_mem_read(ap, readback, ram, words * 4);
+		if (memcmp(pattern, readback, words * 4))
+			ok = false;
+		if (adiv5_dp_error(dp))
+			ok = false;
+	}
+	/* A WAIT or FAULT that was retried still means a marginal clock */
+	return ok && (e.type == 0) && (dp->ack_errors == 0);
+}
+
+/* Step the SWD clock upward, checking each step with repeated IDCODE
+ * reads and a pattern written to and read back from target RAM, with
+ * no bad ACKs or parity errors.  The clock is left one step below the
+ * fastest working one for margin.  The RAM contents are restored afterwards.
+ * Only call this with the target halted.
+ * Returns the chosen frequency, or 0 if calibration was not possible.
+ */
+uint32_t adiv5_swdp_calibrate(ADIv5_AP_t *ap, uint32_t ram, size_t len)
+{
+	ADIv5_DP_t *dp = ap->dp;
+	uint32_t saved[SWDP_CALIBRATE_WORDS];
+	uint32_t pattern[SWDP_CALIBRATE_WORDS];
+	size_t words = MIN(len / 4, SWDP_CALIBRATE_WORDS);
+	uint32_t start_freq = platform_max_frequency_get();
+	uint32_t freq = 0, last = 0, good_freq = 0;
+	int good = -1, failed = -1;
+
+	swdp_calibrated_frequency = 0;
+	if ((dp->dp_read != adiv5_swdp_read) || (words == 0))
+		return 0;
+
+	for (size_t i = 0; i < words; i++) {
+		uint32_t bit = 1u << (i & 31);
+		switch (i & 3) {
+		case 0: pattern[i] = 0x55555555; break;
+		case 1: pattern[i] = 0xAAAAAAAA; break;
+		case 2: pattern[i] = bit; break;
+		case 3: pattern[i] = ~bit; break;
+		}
+	}
+	adiv5_mem_read(ap, saved, ram, words * 4);
+
+	for (unsigned i = 0;
+	     i < sizeof(swdp_calibrate_freqs) / sizeof(swdp_calibrate_freqs[0]);
+	     i++) {
+		platform_max_frequency_set(swdp_calibrate_freqs[i]);
+		freq = platform_max_frequency_get();
+		if (freq == last)
+			continue;	/* Divisor rounded to the same clock */
+		last = freq;
+		if (!adiv5_swdp_calibrate_step(ap, ram, pattern, words)) {
+			failed = i;
+			break;
+		}
+		good = i;
+		good_freq = freq;
+	}
+
+	/* Back off one working step from the edge for margin, also when
+	 * the fastest candidate worked */
+	if (good > 0) {
+		for (int i = good - 1; i >= 0; i--) {
+			platform_max_frequency_set(swdp_calibrate_freqs[i]);
+			if (platform_max_frequency_get() < good_freq)
+				break;
+		}
+	} else if (good >= 0) {
+		platform_max_frequency_set(swdp_calibrate_freqs[good]);
+	} else {
+		platform_max_frequency_set(start_freq);
+	}
+	if (failed >= 0) {
+		adiv5_swdp_line_reset(dp);
+		adiv5_swdp_error(dp);
+	}
+
+	adiv5_mem_write(ap, ram, saved, words * 4);
+	if (good < 0)
+		return 0;
+	swdp_calibrated_frequency = platform_max_frequency_get();
+	DEBUG("SWD clock calibrated to %" PRIu32 " Hz\n",
+	      swdp_calibrated_frequency);
+	return swdp_calibrated_frequency;
+}
+#endif
@@ -35,13 +35,18 @@
 #include "command.h"
 
 #include <unistd.h>
+#if defined(LIBFTDI)
+#	include <time.h>
+#endif
 
 static const char cortexm_driver_str[] = "ARM Cortex-M";
 
 static bool cortexm_vector_catch(target *t, int argc, char *argv[]);
+static bool cortexm_cpu_freq(target *t, int argc, char *argv[]);
 
 const struct command_s cortexm_cmd_list[] = {
 	{"vector_catch", (cmd_handler)cortexm_vector_catch, "Catch exception vectors"},
+	{"cpu_freq", (cmd_handler)cortexm_cpu_freq, "Core clock (Hz) for semihosting SYS_ELAPSED to count cycles, 0 for ms: [(frequency)]"},
 	{NULL, NULL, NULL}
 };
 
@@ -51,6 +56,8 @@ const struct command_s cortexm_cmd_list[] = {
 
 static void cortexm_regs_read(target *t, void *data);
 static void cortexm_regs_write(target *t, const void *data);
+static ssize_t cortexm_reg_read(target *t, int reg, void *data, size_t max);
+static ssize_t cortexm_reg_write(target *t, int reg, const void *data, size_t size);
 static uint32_t cortexm_pc_read(target *t);
 
 static void cortexm_reset(target *t);
@@ -64,6 +71,7 @@ static target_addr cortexm_check_watch(target *t);
 
 #define CORTEXM_MAX_WATCHPOINTS	4	/* architecture says up to 15, no implementation has > 4 */
 #define CORTEXM_MAX_BREAKPOINTS	6	/* architecture says up to 127, no implementation has > 6 */
+#define CORTEXM_POLL_WAIT_TIMEOUT	10	/* ms of WAIT responses before a poll says running */
 
 static int cortexm_hostio_request(target *t);
 
@@ -83,6 +91,11 @@ struct cortexm_priv {
 	/* Cache parameters */
 	bool has_cache;
 	uint32_t dcache_minline;
+	/* Semihosting clocks */
+	uint32_t clock_base;
+	uint32_t cpu_freq;
+	uint32_t cyccnt_last;
+	uint32_t cyccnt_high;
 };
 
 /* Register number tables */
@@ -283,6 +296,8 @@ bool cortexm_probe(ADIv5_AP_t *ap, bool forced)
 	t->tdesc = tdesc_cortex_m;
 	t->regs_read = cortexm_regs_read;
 	t->regs_write = cortexm_regs_write;
+	t->reg_read = cortexm_reg_read;
+	t->reg_write = cortexm_reg_write;
 
 	t->reset = cortexm_reset;
 	t->halt_request = cortexm_halt_request;
@@ -365,9 +380,18 @@ bool cortexm_attach(target *t)
 	if (!cortexm_forced_halt(t))
 		return false;
 
+#if defined(PLATFORM_HAS_FREQUENCY)
+	/* Find the fastest reliable SWD clock, now that we can use RAM */
+	if (swdp_calibrate && t->ram)
+		adiv5_swdp_calibrate(priv->ap, t->ram->start, t->ram->length);
+#endif
+
 	/* Request halt on reset */
 	target_mem_write32(t, CORTEXM_DEMCR, priv->demcr);
 
+	/* SYS_CLOCK counts from here */
+	priv->clock_base = platform_time_ms();
+
 	/* Reset DFSR flags */
 	target_mem_write32(t, CORTEXM_DFSR, CORTEXM_DFSR_RESETALL);
 
@@ -429,28 +453,36 @@ static void cortexm_regs_read(target *t, void *data)
 	unsigned i;
 
 	/* FIXME: Describe what's really going on here */
-	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+	adiv5_ap_queue_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
 
 	/* Map the banked data registers (0x10-0x1c) to the
 	 * debug registers DHCSR, DCRSR, DCRDR and DEMCR respectively */
-	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR, NULL);
 
 	/* Walk the regnum_cortex_m array, reading the registers it
-	 * calls out. */
-	adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[0]); /* Required to switch banks */
-	*regs++ = adiv5_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR));
+	 * calls out.  The whole lot is queued and goes out in one batch. */
+	adiv5_ap_queue_write(ap, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[0]); /* Required to switch banks */
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DB(DB_DCRDR), 0, NULL);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF, 0, regs++);
 	for(i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
-		                    regnum_cortex_m[i]);
-		*regs++ = adiv5_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR));
+		adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
+		               regnum_cortex_m[i], NULL);
+		adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DB(DB_DCRDR),
+		               0, NULL);
+		adiv5_dp_queue(ap->dp, ADIV5_LOW_READ, ADIV5_DP_RDBUFF,
+		               0, regs++);
 	}
 	if (t->target_options & TOPT_FLAVOUR_V7MF)
 		for(i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
-			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
-			                    ADIV5_AP_DB(DB_DCRSR),
-			                    regnum_cortex_mf[i]);
-			*regs++ = adiv5_dp_read(ap->dp, ADIV5_AP_DB(DB_DCRDR));
+			adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE,
+			               ADIV5_AP_DB(DB_DCRSR),
+			               regnum_cortex_mf[i], NULL);
+			adiv5_dp_queue(ap->dp, ADIV5_LOW_READ,
+			               ADIV5_AP_DB(DB_DCRDR), 0, NULL);
+			adiv5_dp_queue(ap->dp, ADIV5_LOW_READ,
+			               ADIV5_DP_RDBUFF, 0, regs++);
 		}
+	adiv5_dp_queue_flush(ap->dp);
 }
 
 static void cortexm_regs_write(target *t, const void *data)
@@ -460,31 +492,121 @@ static void cortexm_regs_write(target *t, const void *data)
 	unsigned i;
 
 	/* FIXME: Describe what's really going on here */
-	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+	adiv5_ap_queue_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
 
 	/* Map the banked data registers (0x10-0x1c) to the
 	 * debug registers DHCSR, DCRSR, DCRDR and DEMCR respectively */
-	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR);
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR, NULL);
 
 	/* Walk the regnum_cortex_m array, writing the registers it
 	 * calls out. */
-	adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRDR), *regs++); /* Required to switch banks */
-	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
-	                    0x10000 | regnum_cortex_m[0]);
+	adiv5_ap_queue_write(ap, ADIV5_AP_DB(DB_DCRDR), *regs++); /* Required to switch banks */
+	adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
+	               0x10000 | regnum_cortex_m[0], NULL);
 	for(i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
-		                    ADIV5_AP_DB(DB_DCRDR), *regs++);
-		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
-		                    0x10000 | regnum_cortex_m[i]);
+		adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE,
+		               ADIV5_AP_DB(DB_DCRDR), *regs++, NULL);
+		adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
+		               0x10000 | regnum_cortex_m[i], NULL);
 	}
 	if (t->target_options & TOPT_FLAVOUR_V7MF)
 		for(i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
-			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
-			                    ADIV5_AP_DB(DB_DCRDR), *regs++);
-			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
-			                    ADIV5_AP_DB(DB_DCRSR),
-			                    0x10000 | regnum_cortex_mf[i]);
+			adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE,
+			               ADIV5_AP_DB(DB_DCRDR), *regs++, NULL);
+			adiv5_dp_queue(ap->dp, ADIV5_LOW_WRITE,
+			               ADIV5_AP_DB(DB_DCRSR),
+			               0x10000 | regnum_cortex_mf[i], NULL);
 		}
+	adiv5_dp_queue_flush(ap->dp);
+}
+
+/* GDB register numbers follow the target descriptions: r0-r15, xpsr,
+ * msp, psp, then the four special registers packed into one core
+ * register, then fpscr and d0-d15 on FPU parts. */
+#define REGNUM_SPECIAL_FIRST	19
+#define REGNUM_FPSCR		23
+#define REGNUM_D0		24
+#define REGNUM_D15		39
+
+static uint32_t cortexm_core_reg_read(target *t, uint32_t regsel)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	uint32_t val = 0;
+
+	adiv5_mem_queue_write32(ap, CORTEXM_DCRSR, regsel);
+	adiv5_mem_queue_read32(ap, CORTEXM_DCRDR, &val);
+	adiv5_dp_queue_flush(ap->dp);
+	return val;
+}
+
+static void cortexm_core_reg_write(target *t, uint32_t regsel, uint32_t val)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+
+	adiv5_mem_queue_write32(ap, CORTEXM_DCRDR, val);
+	adiv5_mem_queue_write32(ap, CORTEXM_DCRSR, CORTEXM_DCRSR_REGWnR | regsel);
+	adiv5_dp_queue_flush(ap->dp);
+}
+
+static ssize_t cortexm_reg_read(target *t, int reg, void *data, size_t max)
+{
+	bool fpu = t->target_options & TOPT_FLAVOUR_V7MF;
+	uint32_t val[2];
+	size_t size = 4;
+
+	if (reg < 0)
+		return -1;
+	if (reg < REGNUM_SPECIAL_FIRST) {
+		val[0] = cortexm_core_reg_read(t, regnum_cortex_m[reg]);
+	} else if (reg < REGNUM_FPSCR) {
+		val[0] = cortexm_core_reg_read(t, regnum_cortex_m[REG_SPECIAL]);
+		val[0] >>= (reg - REGNUM_SPECIAL_FIRST) * 8;
+		size = 1;
+	} else if (fpu && (reg == REGNUM_FPSCR)) {
+		val[0] = cortexm_core_reg_read(t, regnum_cortex_mf[0]);
+	} else if (fpu && (reg <= REGNUM_D15)) {
+		/* dN is made up of s(2N) and s(2N+1) */
+		uint32_t s = regnum_cortex_mf[1 + (reg - REGNUM_D0) * 2];
+		val[0] = cortexm_core_reg_read(t, s);
+		val[1] = cortexm_core_reg_read(t, s + 1);
+		size = 8;
+	} else {
+		return -1;
+	}
+
+	if (size > max)
+		return -1;
+	memcpy(data, val, size);
+	return size;
+}
+
+static ssize_t cortexm_reg_write(target *t, int reg, const void *data, size_t size)
+{
+	bool fpu = t->target_options & TOPT_FLAVOUR_V7MF;
+	uint32_t val[2] = {0, 0};
+
+	if ((reg < 0) || (size > sizeof(val)))
+		return -1;
+	memcpy(val, data, size);
+
+	if ((reg < REGNUM_SPECIAL_FIRST) && (size == 4)) {
+		cortexm_core_reg_write(t, regnum_cortex_m[reg], val[0]);
+	} else if ((reg < REGNUM_FPSCR) && (size == 1)) {
+		unsigned shift = (reg - REGNUM_SPECIAL_FIRST) * 8;
+		uint32_t special = cortexm_core_reg_read(t, regnum_cortex_m[REG_SPECIAL]);
+		special &= ~(0xffu << shift);
+		special |= val[0] << shift;
+		cortexm_core_reg_write(t, regnum_cortex_m[REG_SPECIAL], special);
+	} else if (fpu && (reg == REGNUM_FPSCR) && (size == 4)) {
+		cortexm_core_reg_write(t, regnum_cortex_mf[0], val[0]);
+	} else if (fpu && (reg <= REGNUM_D15) && (size == 8)) {
+		uint32_t s = regnum_cortex_mf[1 + (reg - REGNUM_D0) * 2];
+		cortexm_core_reg_write(t, s, val[0]);
+		cortexm_core_reg_write(t, s + 1, val[1]);
+	} else {
+		return -1;
+	}
+	return size;
 }
 
 int cortexm_mem_write_sized(
@@ -514,6 +636,8 @@ static void cortexm_reset(target *t)
 	if ((t->target_options & CORTEXM_TOPT_INHIBIT_SRST) == 0) {
 		platform_srst_set_val(true);
 		platform_srst_set_val(false);
+		/* Some parts take the DAP down with the system reset */
+		adiv5_dp_cache_invalidate(cortexm_ap(t)->dp);
 	}
 
 	/* Read DHCSR here to clear S_RESET_ST bit before reset */
@@ -560,13 +684,21 @@ static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch)
 {
 	struct cortexm_priv *priv = t->priv;
 
-	volatile uint32_t dhcsr = 0;
+	ADIv5_AP_t *ap = cortexm_ap(t);
+
+	uint32_t dhcsr = 0;
 	volatile struct exception e;
+	/* Don't sit out the full WAIT budget on every poll, a target
+	 * in deep sleep would hold up Ctrl-C for seconds. */
+	uint32_t wait_timeout = ap->dp->wait_timeout;
+	ap->dp->wait_timeout = CORTEXM_POLL_WAIT_TIMEOUT;
 	TRY_CATCH (e, EXCEPTION_ALL) {
 		/* If this times out because the target is in WFI then
 		 * the target is still running. */
-		dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
+		adiv5_mem_queue_read32(ap, CORTEXM_DHCSR, &dhcsr);
+		adiv5_dp_queue_flush(ap->dp);
 	}
+	ap->dp->wait_timeout = wait_timeout;
 	switch (e.type) {
 	case EXCEPTION_ERROR:
 		/* Oh crap, there's no recovery from this... */
@@ -580,8 +712,13 @@ static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch)
 	if (!(dhcsr & CORTEXM_DHCSR_S_HALT))
 		return TARGET_HALT_RUNNING;
 
-	/* We've halted.  Let's find out why. */
-	uint32_t dfsr = target_mem_read32(t, CORTEXM_DFSR);
+	/* We've halted.  Let's find out why.  The PC is fetched in the
+	 * same batch, we need it if we stopped on a breakpoint. */
+	uint32_t dfsr = 0, pc = 0;
+	adiv5_mem_queue_read32(ap, CORTEXM_DFSR, &dfsr);
+	adiv5_mem_queue_write32(ap, CORTEXM_DCRSR, 0x0F);
+	adiv5_mem_queue_read32(ap, CORTEXM_DCRDR, &pc);
+	adiv5_dp_queue_flush(ap->dp);
 	target_mem_write32(t, CORTEXM_DFSR, dfsr); /* write back to reset */
 
 	if ((dfsr & CORTEXM_DFSR_VCATCH) && cortexm_fault_unwind(t))
@@ -592,7 +729,6 @@ static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch)
 	if (priv->on_bkpt) {
 		/* If we've hit a programmed breakpoint, check for semihosting
 		 * call. */
-		uint32_t pc = cortexm_pc_read(t);
 		uint16_t bkpt_instr;
 		bkpt_instr = target_mem_read16(t, pc);
 		if (bkpt_instr == 0xBEAB) {
@@ -718,6 +854,9 @@ int cortexm_run_stub(target *t, uint32_t loadaddr,
 	regs[16] = 0x1000000;
 	regs[19] = 0;
 
+	/* The stub runs behind the target layer's back */
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
 	cortexm_regs_write(t, regs);
 
 	if (target_check_error(t))
@@ -908,6 +1047,19 @@ static bool cortexm_vector_catch(target *t, int argc, char *argv[])
 	return true;
 }
 
+static bool cortexm_cpu_freq(target *t, int argc, char *argv[])
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (argc > 1)
+		priv->cpu_freq = strtoul(argv[1], NULL, 0);
+	if (priv->cpu_freq)
+		tc_printf(t, "Core clock: %" PRIu32 " Hz\n", priv->cpu_freq);
+	else
+		tc_printf(t, "Core clock unknown, SYS_ELAPSED counts ms\n");
+	return true;
+}
+
 /* Windows defines this with some other meaning... */
 #ifdef SYS_OPEN
 #	undef SYS_OPEN
@@ -938,8 +1090,73 @@ static bool cortexm_vector_catch(target *t, int argc, char *argv[])
 #define SYS_WRITEC	0x03
 #define SYS_WRITE0	0x04
 
+/* Reads the DWT cycle counter, enabling it if needed, and extends it
+ * to 64 bits.  Wraps are only seen if there's at most one per call. */
+static bool cortexm_cycles(target *t, uint64_t *cycles)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	/* The DWT is off, and reads as zeros, without TRCENA */
+	uint32_t demcr = target_mem_read32(t, CORTEXM_DEMCR);
+	if (!(demcr & CORTEXM_DEMCR_TRCENA))
+		target_mem_write32(t, CORTEXM_DEMCR,
+		                   demcr | CORTEXM_DEMCR_TRCENA);
+
+	uint32_t ctrl = target_mem_read32(t, CORTEXM_DWT_CTRL);
+	if (ctrl & CORTEXM_DWT_CTRL_NOCYCCNT)
+		return false;
+	if (!(ctrl & CORTEXM_DWT_CTRL_CYCCNTENA)) {
+		/* ARMv6-M has no counter, the enable reads as zero */
+		target_mem_write32(t, CORTEXM_DWT_CTRL,
+		                   ctrl | CORTEXM_DWT_CTRL_CYCCNTENA);
+		if (!(target_mem_read32(t, CORTEXM_DWT_CTRL) &
+		      CORTEXM_DWT_CTRL_CYCCNTENA))
+			return false;
+	}
+	uint32_t count = target_mem_read32(t, CORTEXM_DWT_CYCCNT);
+	if (count < priv->cyccnt_last)
+		priv->cyccnt_high++;
+	priv->cyccnt_last = count;
+	*cycles = ((uint64_t)priv->cyccnt_high << 32) | count;
+	return true;
+}
+
+#if defined(LIBFTDI)
+static int32_t cortexm_time(target *t, uint32_t sp)
+{
+	(void)t;
+	(void)sp;
+	return time(NULL);
+}
+#else
+/* There's no calendar on the probe, so GDB is asked for the time once
+ * and the probe's clock is used from then on. */
+static int32_t cortexm_time(target *t, uint32_t sp)
+{
+	static bool time_valid;
+	static int32_t time_offset;
+
+	if (!time_valid) {
+		/* GDB's struct timeval, in the free stack below sp */
+		uint8_t tv[12], save[sizeof(tv)];
+		target_addr addr = (sp - 16) & ~7;
+
+		if (target_mem_read(t, save, addr, sizeof(save)) ||
+		    tc_gettimeofday(t, addr, 0) ||
+		    target_mem_read(t, tv, addr, sizeof(tv)))
+			return -1;
+		target_mem_write(t, addr, save, sizeof(save));
+		time_offset = ((tv[0] << 24) | (tv[1] << 16) | (tv[2] << 8) | tv[3]) -
+		              platform_time_ms() / 1000;
+		time_valid = true;
+	}
+	return time_offset + platform_time_ms() / 1000;
+}
+#endif
+
 static int cortexm_hostio_request(target *t)
 {
+	struct cortexm_priv *priv = t->priv;
 	uint32_t arm_regs[t->regs_size];
 	uint32_t params[4];
 
@@ -993,13 +1210,43 @@ static int cortexm_hostio_request(target *t)
 			ret = params[2] - ret;
 		break;
 	case SYS_WRITE:	/* write */
-		ret = tc_write(t, params[0] - 1, params[1], params[2]);
+		ret = -1;
+		/* Console output may be written by the controller itself */
+		if ((params[0] - 1 == STDOUT_FILENO) ||
+		    (params[0] - 1 == STDERR_FILENO))
+			ret = tc_console_write(t, params[1], params[2]);
+		if (ret < 0)
+			ret = tc_write(t, params[0] - 1, params[1], params[2]);
 		if (ret > 0)
 			ret = params[2] - ret;
 		break;
 	case SYS_WRITEC: /* writec */
-		ret = tc_write(t, 2, arm_regs[1], 1);
+		if (tc_console_write(t, arm_regs[1], 1) < 0)
+			tc_write(t, 2, arm_regs[1], 1);
 		break;
+	case SYS_WRITE0: { /* write0 */
+		/* Find the terminator, then write the string in one go */
+		char buf[32];
+		uint32_t len = 0;
+		size_t chunk = sizeof(buf);
+		for (;;) {
+			if (target_mem_read(t, buf, arm_regs[1] + len, chunk)) {
+				/* The string may end just before the end of
+				 * a region, finish it a byte at a time */
+				if (chunk == 1)
+					break;
+				chunk = 1;
+				continue;
+			}
+			size_t n = strnlen(buf, chunk);
+			len += n;
+			if (n < chunk)
+				break;
+		}
+		if (len && (tc_console_write(t, arm_regs[1], len) < 0))
+			tc_write(t, 2, arm_regs[1], len);
+		break;
+		}
 	case SYS_ISTTY:	/* isatty */
 		ret = tc_isatty(t, params[0] - 1);
 		break;
@@ -1017,16 +1264,53 @@ static int cortexm_hostio_request(target *t)
 		ret = tc_system(t, params[0] - 1, params[1] + 1);
 		break;
 
-	case SYS_FLEN:	/* Not supported, fake success */
-		t->tc->errno_ = 0;
+	case SYS_FLEN: { /* flen */
+		/* Seek to the end and back */
+		long pos = tc_lseek(t, params[0] - 1, 0, TARGET_SEEK_CUR);
+		if (pos < 0) {
+			ret = -1;
+			break;
+		}
+		ret = tc_lseek(t, params[0] - 1, 0, TARGET_SEEK_END);
+		tc_lseek(t, params[0] - 1, pos, TARGET_SEEK_SET);
 		break;
+		}
 
 	case SYS_ERRNO: /* Return last errno from GDB */
 		ret = t->tc->errno_;
 		break;
 
-	case SYS_TIME:	/* gettimeofday */
-		/* FIXME How do we use gdb's gettimeofday? */
+	case SYS_TIME:	/* time */
+		ret = cortexm_time(t, arm_regs[REG_SP]);
+		break;
+
+	case SYS_CLOCK:	/* clock, in centiseconds */
+		ret = (platform_time_ms() - priv->clock_base) / 10;
+		break;
+
+	case SYS_ELAPSED: { /* elapsed */
+		/* Core cycles if we know how fast they are, else ms */
+		uint64_t ticks;
+		if (!priv->cpu_freq || !cortexm_cycles(t, &ticks))
+			ticks = platform_time_ms() - priv->clock_base;
+		uint32_t val[2] = { ticks, ticks >> 32 };
+		ret = target_mem_write(t, arm_regs[1], val, sizeof(val)) ? -1 : 0;
+		break;
+		}
+
+	case SYS_TICKFREQ: { /* tickfreq */
+		uint64_t ticks;
+		if (priv->cpu_freq && cortexm_cycles(t, &ticks))
+			ret = priv->cpu_freq;
+		else
+			ret = 1000;
+		break;
+		}
+
+	case SYS_HEAPINFO: /* heapinfo */
+		/* Unknown to the probe, the C library falls back to its
+		 * linker symbols on failure */
+		ret = -1;
 		break;
 	}
 
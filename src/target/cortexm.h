@@ -59,6 +59,7 @@ extern long cortexm_wait_timeout;
 #define CORTEXM_DWT_BASE	(CORTEXM_PPB_BASE + 0x1000)
 
 #define CORTEXM_DWT_CTRL	(CORTEXM_DWT_BASE + 0x000)
+#define CORTEXM_DWT_CYCCNT	(CORTEXM_DWT_BASE + 0x004)	/* v7m only */
 #define CORTEXM_DWT_COMP(i)	(CORTEXM_DWT_BASE + 0x020 + (0x10*(i)))
 #define CORTEXM_DWT_MASK(i)	(CORTEXM_DWT_BASE + 0x024 + (0x10*(i)))
 #define CORTEXM_DWT_FUNC(i)	(CORTEXM_DWT_BASE + 0x028 + (0x10*(i)))
@@ -144,6 +145,10 @@ extern long cortexm_wait_timeout;
 #define CORTEXM_FPB_CTRL_KEY		(1 << 1)
 #define CORTEXM_FPB_CTRL_ENABLE		(1 << 0)
 
+/* Data Watchpoint and Trace Control Register (DWT_CTRL) */
+#define CORTEXM_DWT_CTRL_NOCYCCNT	(1 << 25)	/* v7m only */
+#define CORTEXM_DWT_CTRL_CYCCNTENA	(1 << 0)	/* v7m only */
+
 /* Data Watchpoint and Trace Mask Register (DWT_MASKx) */
 #define CORTEXM_DWT_MASK_BYTE		(0 << 0)
 #define CORTEXM_DWT_MASK_HALFWORD	(1 << 0)
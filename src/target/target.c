@@ -70,6 +70,17 @@ void target_mem_map_free(target *t)
 	}
 }
 
+/* The driver clears the hardware on attach and detach, forget the
+ * break-/watchpoints with it so the next set programs them again. */
+static void target_breakwatch_free(target *t)
+{
+	while (t->bw_list) {
+		void * next = t->bw_list->next;
+		free(t->bw_list);
+		t->bw_list = next;
+	}
+}
+
 void target_list_free(void)
 {
 	struct target_command_s *tc;
@@ -86,11 +97,10 @@ void target_list_free(void)
 			target_list->commands = tc;
 		}
 		target_mem_map_free(target_list);
-		while (target_list->bw_list) {
-			void * next = target_list->bw_list->next;
-			free(target_list->bw_list);
-			target_list->bw_list = next;
-		}
+		free(target_list->regs_cache);
+		free(target_list->reg_cache);
+		free(target_list->mem_cache);
+		target_breakwatch_free(target_list);
 		free(target_list);
 		target_list = t;
 	}
@@ -126,6 +136,10 @@ target *target_attach(target *t, struct target_controller *tc)
 		t->tc->destroy_callback(t->tc, t);
 
 	t->tc = tc;
+	tc->t = t;
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	target_breakwatch_free(t);
 
 	if (!t->attach(t))
 		return NULL;
@@ -208,6 +222,7 @@ int target_flash_erase(target *t, target_addr addr, size_t len)
 		addr += tmplen;
 		len -= tmplen;
 	}
+	target_mem_cache_invalidate(t);
 	return ret;
 }
 
@@ -224,11 +239,13 @@ int target_flash_write(target *t,
 		src += tmplen;
 		len -= tmplen;
 	}
+	target_mem_cache_invalidate(t);
 	return ret;
 }
 
 int target_flash_done(target *t)
 {
+	target_mem_cache_invalidate(t);
 	for (struct target_flash *f = t->flash; f; f = f->next) {
 		int tmp = target_flash_done_buffered(f);
 		if (tmp)
@@ -292,8 +309,11 @@ int target_flash_done_buffered(struct target_flash *f)
 /* Wrapper functions */
 void target_detach(target *t)
 {
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
 	t->detach(t);
 	t->attached = false;
+	target_breakwatch_free(t);
 #if defined(LIBFTDI)
 # include "platform.h"
 	platform_buffer_flush();
@@ -304,31 +324,184 @@ bool target_check_error(target *t) { return t->check_error(t); }
 bool target_attached(target *t) { return t->attached; }
 
 /* Memory access functions */
+void target_mem_cache_invalidate(target *t)
+{
+	if (t->mem_cache)
+		for (unsigned i = 0; i < TARGET_MEM_CACHE_LINES; i++)
+			t->mem_cache->line[i].valid = false;
+}
+
+/* Find or fill the cache line at addr, only flash is cached as it
+ * can't change under us while the target is halted. */
+static const uint8_t *mem_cache_line(target *t, target_addr addr)
+{
+	struct target_mem_cache *c;
+	struct target_flash *f = flash_for_addr(t, addr);
+
+	if (!f || (addr + TARGET_MEM_CACHE_LINE > f->start + f->length))
+		return NULL;
+
+	if (!t->mem_cache)
+		t->mem_cache = calloc(1, sizeof(*t->mem_cache));
+	if (!(c = t->mem_cache))
+		return NULL;
+
+	for (unsigned i = 0; i < TARGET_MEM_CACHE_LINES; i++)
+		if (c->line[i].valid && (c->line[i].addr == addr))
+			return c->line[i].data;
+
+	unsigned i = c->victim++ % TARGET_MEM_CACHE_LINES;
+	t->mem_read(t, c->line[i].data, addr, TARGET_MEM_CACHE_LINE);
+	if (target_check_error(t)) {
+		/* Let the caller's own access pick up the fault */
+		c->line[i].valid = false;
+		return NULL;
+	}
+	c->line[i].addr = addr;
+	c->line[i].valid = true;
+	return c->line[i].data;
+}
+
+static void target_mem_read_cached(target *t, void *dest, target_addr src, size_t len)
+{
+	uint8_t *d = dest;
+
+	/* Bulk reads go straight through, they would only thrash the cache */
+	if (t->running || (len > TARGET_MEM_CACHE_LINE * 2)) {
+		t->mem_read(t, dest, src, len);
+		return;
+	}
+	while (len) {
+		target_addr line = src & ~(TARGET_MEM_CACHE_LINE - 1);
+		size_t offset = src - line;
+		size_t chunk = MIN(len, TARGET_MEM_CACHE_LINE - offset);
+		const uint8_t *data = mem_cache_line(t, line);
+		if (data)
+			memcpy(d, data + offset, chunk);
+		else
+			t->mem_read(t, d, src, chunk);
+		d += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+}
+
 int target_mem_read(target *t, void *dest, target_addr src, size_t len)
 {
-	t->mem_read(t, dest, src, len);
+	target_mem_read_cached(t, dest, src, len);
 	return target_check_error(t);
 }
 
 int target_mem_write(target *t, target_addr dest, const void *src, size_t len)
 {
+	target_mem_cache_invalidate(t);
 	t->mem_write(t, dest, src, len);
 	return target_check_error(t);
 }
 
 /* Register access functions */
-void target_regs_read(target *t, void *data) { t->regs_read(t, data); }
-void target_regs_write(target *t, const void *data) { t->regs_write(t, data); }
+void target_regs_cache_invalidate(target *t)
+{
+	t->regs_cache_valid = false;
+	if (t->reg_cache)
+		t->reg_cache->valid = 0;
+}
+
+void target_regs_read(target *t, void *data)
+{
+	if (!t->regs_cache)
+		t->regs_cache = malloc(t->regs_size);
+
+	if (t->regs_cache && t->regs_cache_valid) {
+		memcpy(data, t->regs_cache, t->regs_size);
+		return;
+	}
+	t->regs_read(t, data);
+	if (t->regs_cache && !target_check_error(t)) {
+		memcpy(t->regs_cache, data, t->regs_size);
+		t->regs_cache_valid = true;
+	}
+}
+
+void target_regs_write(target *t, const void *data)
+{
+	target_regs_cache_invalidate(t);
+	t->regs_write(t, data);
+}
+
+/* Single register access by GDB register number.  Returns the register
+ * size, 0 if the target doesn't support this or -1 on error. */
+ssize_t target_reg_read(target *t, int reg, void *data, size_t max)
+{
+	struct target_reg_cache *c;
+	ssize_t ret;
+
+	if (!t->reg_read)
+		return 0;
+	if ((reg < 0) || (reg >= TARGET_REG_CACHE_SIZE))
+		return t->reg_read(t, reg, data, max);
+
+	if (!t->reg_cache)
+		t->reg_cache = calloc(1, sizeof(*t->reg_cache));
+	c = t->reg_cache;
+
+	if (c && (c->valid & (1ULL << reg))) {
+		if (c->size[reg] > max)
+			return -1;
+		memcpy(data, c->data[reg], c->size[reg]);
+		return c->size[reg];
+	}
+
+	ret = t->reg_read(t, reg, data, max);
+	if ((ret > 0) && target_check_error(t))
+		return -1;
+	if (c && (ret > 0) && ((size_t)ret <= sizeof(c->data[reg]))) {
+		memcpy(c->data[reg], data, ret);
+		c->size[reg] = ret;
+		c->valid |= 1ULL << reg;
+	}
+	return ret;
+}
+
+ssize_t target_reg_write(target *t, int reg, const void *data, size_t size)
+{
+	ssize_t ret;
+
+	if (!t->reg_write)
+		return 0;
+	/* Registers alias each other (sp/msp/psp), drop everything */
+	target_regs_cache_invalidate(t);
+	ret = t->reg_write(t, reg, data, size);
+	if ((ret > 0) && target_check_error(t))
+		return -1;
+	return ret;
+}
 
 /* Halt/resume functions */
-void target_reset(target *t) { t->reset(t); }
+void target_reset(target *t)
+{
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	t->reset(t);
+}
+
 void target_halt_request(target *t) { t->halt_request(t); }
 enum target_halt_reason target_halt_poll(target *t, target_addr *watch)
 {
-	return t->halt_poll(t, watch);
+	enum target_halt_reason reason = t->halt_poll(t, watch);
+	/* The target may be gone after an error */
+	if ((reason != TARGET_HALT_RUNNING) && (reason != TARGET_HALT_ERROR))
+		t->running = false;
+	return reason;
 }
 
-void target_halt_resume(target *t, bool step) { t->halt_resume(t, step); }
+void target_halt_resume(target *t, bool step)
+{
+	target_regs_cache_invalidate(t);
+	target_mem_cache_invalidate(t);
+	t->running = true;
+	t->halt_resume(t, step);
+}
 
 /* Break-/watchpoint functions */
 int target_breakwatch_set(target *t,
@@ -338,9 +511,17 @@ int target_breakwatch_set(target *t,
 		.type = type,
 		.addr = addr,
 		.size = len,
+		.refs = 1,
 	};
 	int ret = 1;
 
+	/* Shared by GDB and a tracepoint, each sets and clears its own */
+	for (struct breakwatch *b = t->bw_list; b; b = b->next)
+		if ((b->type == type) && (b->addr == addr) && (b->size == len)) {
+			b->refs++;
+			return 0;
+		}
+
 	if (t->breakwatch_set)
 		ret = t->breakwatch_set(t, &bw);
 
@@ -369,6 +550,9 @@ int target_breakwatch_clear(target *t,
 	if (bw == NULL)
 		return -1;
 
+	if (--bw->refs)
+		return 0;
+
 	if (t->breakwatch_clear)
 		ret = t->breakwatch_clear(t, bw);
 
@@ -379,10 +563,27 @@ int target_breakwatch_clear(target *t,
 			bwp->next = bw->next;
 		}
 		free(bw);
+	} else {
+		bw->refs++;
 	}
 	return ret;
 }
 
+/* Takes every breakpoint at addr out of the hardware, or puts them back,
+ * so the target can be stepped off addr whoever owns them. */
+void target_breakwatch_lift(target *t, target_addr addr, bool lift)
+{
+	for (struct breakwatch *bw = t->bw_list; bw; bw = bw->next) {
+		if ((bw->addr != addr) ||
+		    ((bw->type != TARGET_BREAK_SOFT) && (bw->type != TARGET_BREAK_HARD)))
+			continue;
+		if (lift && t->breakwatch_clear)
+			t->breakwatch_clear(t, bw);
+		else if (!lift && t->breakwatch_set)
+			t->breakwatch_set(t, bw);
+	}
+}
+
 /* Accessor functions */
 size_t target_regs_size(target *t)
 {
@@ -402,36 +603,39 @@ const char *target_driver_name(target *t)
 uint32_t target_mem_read32(target *t, uint32_t addr)
 {
 	uint32_t ret;
-	t->mem_read(t, &ret, addr, sizeof(ret));
+	target_mem_read_cached(t, &ret, addr, sizeof(ret));
 	return ret;
 }
 
 void target_mem_write32(target *t, uint32_t addr, uint32_t value)
 {
+	target_mem_cache_invalidate(t);
 	t->mem_write(t, addr, &value, sizeof(value));
 }
 
 uint16_t target_mem_read16(target *t, uint32_t addr)
 {
 	uint16_t ret;
-	t->mem_read(t, &ret, addr, sizeof(ret));
+	target_mem_read_cached(t, &ret, addr, sizeof(ret));
 	return ret;
 }
 
 void target_mem_write16(target *t, uint32_t addr, uint16_t value)
 {
+	target_mem_cache_invalidate(t);
 	t->mem_write(t, addr, &value, sizeof(value));
 }
 
 uint8_t target_mem_read8(target *t, uint32_t addr)
 {
 	uint8_t ret;
-	t->mem_read(t, &ret, addr, sizeof(ret));
+	target_mem_read_cached(t, &ret, addr, sizeof(ret));
 	return ret;
 }
 
 void target_mem_write8(target *t, uint32_t addr, uint8_t value)
 {
+	target_mem_cache_invalidate(t);
 	t->mem_write(t, addr, &value, sizeof(value));
 }
 
@@ -566,3 +770,34 @@ int tc_system(target *t, target_addr cmd, size_t cmdlen)
 	}
 	return t->tc->system(t->tc, cmd, cmdlen);
 }
+
+#if defined(LIBFTDI)
+#define TC_CONSOLE_CHUNK 1024
+#else
+#define TC_CONSOLE_CHUNK 64
+#endif
+
+/* Write console output through the controller, reading it from the
+ * target here so the host needn't fetch it.  Returns -1 if the
+ * controller doesn't do this and tc_write() should be used. */
+int tc_console_write(target *t, target_addr buf, unsigned int count)
+{
+	uint8_t data[TC_CONSOLE_CHUNK];
+	unsigned int done = 0;
+
+	if (t->tc->console_write == NULL)
+		return -1;
+	while (done < count) {
+		unsigned int len = MIN(count - done, sizeof(data));
+		if (target_mem_read(t, data, buf + done, len)) {
+			if (done)
+				break;
+			t->tc->errno_ = TARGET_EFAULT;
+			return -1;
+		}
+		if (t->tc->console_write(t->tc, data, len) < 0)
+			return done ? (int)done : -1;
+		done += len;
+	}
+	return done;
+}
@@ -69,9 +69,32 @@ struct breakwatch {
 	enum target_breakwatch type;
 	target_addr addr;
 	size_t size;
+	unsigned refs; /* number of owners, cleared on the last */
 	uint32_t reserved[4]; /* for use by the implementing driver */
 };
 
+/* Single registers cached by GDB register number, values up to 64 bits */
+#define TARGET_REG_CACHE_SIZE 40
+struct target_reg_cache {
+	uint64_t valid;
+	uint8_t size[TARGET_REG_CACHE_SIZE];
+	uint8_t data[TARGET_REG_CACHE_SIZE][8];
+};
+
+/* Flash contents cached in lines while the target stays halted */
+#define TARGET_MEM_CACHE_LINE 64
+#ifndef TARGET_MEM_CACHE_LINES
+#define TARGET_MEM_CACHE_LINES 8
+#endif
+struct target_mem_cache {
+	unsigned victim;
+	struct {
+		bool valid;
+		target_addr addr;
+		uint8_t data[TARGET_MEM_CACHE_LINE];
+	} line[TARGET_MEM_CACHE_LINES];
+};
+
 struct target_s {
 	bool attached;
 	struct target_controller *tc;
@@ -92,6 +115,16 @@ struct target_s {
 	const char *tdesc;
 	void (*regs_read)(target *t, void *data);
 	void (*regs_write)(target *t, const void *data);
+	ssize_t (*reg_read)(target *t, int reg, void *data, size_t max);
+	ssize_t (*reg_write)(target *t, int reg, const void *data, size_t size);
+
+	/* Register values are cached while the target stays halted */
+	void *regs_cache;
+	bool regs_cache_valid;
+	struct target_reg_cache *reg_cache;
+	struct target_mem_cache *mem_cache;
+	/* Resumed and not yet seen halted, nothing may be cached */
+	bool running;
 
 	/* Halt/resume functions */
 	void (*reset)(target *t);
@@ -136,6 +169,8 @@ void target_mem_write32(target *t, uint32_t addr, uint32_t value);
 void target_mem_write16(target *t, uint32_t addr, uint16_t value);
 void target_mem_write8(target *t, uint32_t addr, uint8_t value);
 bool target_check_error(target *t);
+void target_regs_cache_invalidate(target *t);
+void target_mem_cache_invalidate(target *t);
 
 /* Access to host controller interface */
 void tc_printf(target *t, const char *fmt, ...);
@@ -156,6 +191,7 @@ int tc_fstat(target *t, int fd, target_addr buf);
 int tc_gettimeofday(target *t, target_addr tv, target_addr tz);
 int tc_isatty(target *t, int fd);
 int tc_system(target *t, target_addr cmd, size_t cmdlen);
+int tc_console_write(target *t, target_addr buf, unsigned int count);
 
 /* Probe for various targets.
  * Actual functions implemented in their respective drivers.